@@ -0,0 +1,33 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<!--
+   Tile compositor shader
+
+   Draws one input stream per tile. renderFrame() binds the tile's stream
+   texture to rubyTexture before each tile is drawn.
+-->
+
+<shader language="GLSL">
+<vertex><![CDATA[
+	attribute vec2 aPosition;
+	attribute vec2 aTexCoord;
+	varying vec2 vTexCoord;
+
+	void main() {
+		vTexCoord = aTexCoord;
+		gl_Position = vec4(aPosition, 0.0, 1.0);
+	}
+]]></vertex>
+
+<fragment filter="linear"><![CDATA[
+	#ifdef GL_FRAGMENT_PRECISION_HIGH
+	precision highp float;
+	#else
+	precision mediump float;
+	#endif
+	uniform sampler2D rubyTexture;
+	varying vec2 vTexCoord;
+	void main() {
+		gl_FragColor = texture2D(rubyTexture, vTexCoord);
+	}
+]]></fragment>
+</shader>
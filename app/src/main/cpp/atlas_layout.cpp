@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------------------------
+// File: atlas_layout.cpp
+// Desc: Packs many input frames into a few large atlas textures.
+//--------------------------------------------------------------------------------------
+#include "atlas_layout.h"
+
+#include <algorithm>
+
+namespace
+{
+struct shelf_t
+{
+    uint32_t y;
+    uint32_t height;
+    uint32_t next_x;
+};
+
+struct page_state_t
+{
+    std::vector<shelf_t> shelves;
+    uint32_t             next_y;
+    uint32_t             used_width;
+    uint32_t             used_height;
+};
+
+bool place_on_page(page_state_t &page, uint32_t width, uint32_t height, uint32_t max_page_size,
+                   uint32_t padding, uint32_t &x, uint32_t &y)
+{
+    for (size_t s = 0; s < page.shelves.size(); ++s)
+    {
+        shelf_t &shelf = page.shelves[s];
+        if (height <= shelf.height && shelf.next_x + width <= max_page_size)
+        {
+            x = shelf.next_x;
+            y = shelf.y;
+            shelf.next_x += width + padding;
+            return true;
+        }
+    }
+    if (page.next_y + height > max_page_size)
+    {
+        return false;
+    }
+
+    // Rectangles come tallest first, so the first one on a shelf sets its height.
+    shelf_t shelf;
+    shelf.y      = page.next_y;
+    shelf.height = height;
+    shelf.next_x = width + padding;
+    page.shelves.push_back(shelf);
+    page.next_y += height + padding;
+    x = 0;
+    y = shelf.y;
+    return true;
+}
+}
+
+bool pack_atlas(const std::vector<atlas_size_t> &sizes, uint32_t max_page_size, uint32_t padding,
+                std::vector<atlas_rect_t> &rects, std::vector<atlas_size_t> &pages)
+{
+    rects.assign(sizes.size(), atlas_rect_t());
+    pages.clear();
+
+    std::vector<size_t> order(sizes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b)
+    {
+        return sizes[a].height > sizes[b].height;
+    });
+
+    std::vector<page_state_t> states;
+    for (size_t o = 0; o < order.size(); ++o)
+    {
+        const size_t   i      = order[o];
+        const uint32_t width  = sizes[i].width;
+        const uint32_t height = sizes[i].height;
+        if (width > max_page_size || height > max_page_size)
+        {
+            return false;
+        }
+
+        uint32_t x = 0, y = 0;
+        size_t   page = 0;
+        while (page < states.size() && !place_on_page(states[page], width, height, max_page_size, padding, x, y))
+        {
+            ++page;
+        }
+        if (page == states.size())
+        {
+            page_state_t state;
+            state.next_y      = 0;
+            state.used_width  = 0;
+            state.used_height = 0;
+            states.push_back(state);
+            place_on_page(states[page], width, height, max_page_size, padding, x, y);
+        }
+
+        page_state_t &state = states[page];
+        state.used_width    = std::max(state.used_width, x + width);
+        state.used_height   = std::max(state.used_height, y + height);
+
+        atlas_rect_t &rect = rects[i];
+        rect.page   = static_cast<uint32_t>(page);
+        rect.x      = x;
+        rect.y      = y;
+        rect.width  = width;
+        rect.height = height;
+    }
+
+    pages.resize(states.size());
+    for (size_t p = 0; p < states.size(); ++p)
+    {
+        pages[p].width  = states[p].used_width;
+        pages[p].height = states[p].used_height;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// File: atlas_layout.h
+// Desc: Packs many input frames into a few large atlas textures.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_ATLAS_LAYOUT_H
+#define ANDROID_SHADER_DEMO_JNI_ATLAS_LAYOUT_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief Where one input lives in an atlas: the page and the top left corner
+ *        of its sub-rectangle, in texels.
+ */
+struct atlas_rect_t
+{
+    uint32_t page;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * \brief A width and height in texels, e.g. of an input or of an atlas page
+ *        trimmed to the rectangles placed on it.
+ */
+struct atlas_size_t
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * \brief Packs rectangles onto as few pages as a shelf packer manages.
+ *
+ *        Rectangles are placed tallest first, left to right along shelves
+ *        that are stacked top to bottom; a rectangle that fits on no page
+ *        opens a new one. padding texels are kept free between neighbours so
+ *        that filtering at a rectangle's edge never reaches into another.
+ *
+ * @param sizes - width and height of every rectangle; rects[i] answers sizes[i]
+ * @param max_page_size - Largest page side, e.g. GL_MAX_TEXTURE_SIZE
+ * @param padding
+ * @param rects [out]
+ * @param pages [out]
+ * @return false if a rectangle is larger than a page
+ */
+bool pack_atlas(const std::vector<atlas_size_t> &sizes, uint32_t max_page_size, uint32_t padding,
+                std::vector<atlas_rect_t> &rects, std::vector<atlas_size_t> &pages);
+
+#endif //ANDROID_SHADER_DEMO_JNI_ATLAS_LAYOUT_H
@@ -5,15 +5,17 @@
 #ifndef ANDROID_SHADER_DEMO_JNI_CL_CODE_H
 #define ANDROID_SHADER_DEMO_JNI_CL_CODE_H
 #include <fstream>
+#include <sys/time.h>
 #include "cl_wrapper.h"
+#include "log_sink.h"
 #include "CL/cl.hpp"
 #define LOG_TAG    "cl_code.hpp"
 
-#define DPRINTF(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define DPRINTF(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
 
-#define IPRINTF(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define IPRINTF(...)  log_print(LOG_LEVEL_INFO,LOG_TAG,__VA_ARGS__)
 
-#define EPRINTF(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#define EPRINTF(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
 
 
 #if 1
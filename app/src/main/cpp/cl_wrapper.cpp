@@ -10,7 +10,7 @@
 //--------------------------------------------------------------------------------------
 #include "cl_wrapper.h"
 #include "util.h"
-#include <android/log.h>
+#include "log_sink.h"
 #include "CL/cl.h"
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -23,7 +23,7 @@
 
 #define LOG_TAG    "cl_wrapper.cpp"
 
-#define DPRINTF1(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
 
 cl_wrapper::cl_wrapper()
 {
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// File: compositor.h
+// Desc: The stitching engine, independent of JNI and of who owns the GL
+//       context.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_COMPOSITOR_H
+#define ANDROID_SHADER_DEMO_JNI_COMPOSITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "readback_pool.h"
+#include "stage_timer.h"
+
+/**
+ * \brief CPU time spent per rendered frame in each stage of the pipeline. GL
+ *        calls are asynchronous, so GPU work shows up in the stage that waits
+ *        for it, usually the read back. Encoding, i.e. writing the output,
+ *        runs on its own thread and overlaps the other stages; its timer is
+ *        only filled in by compositor::flush(). dropped counts the frames
+ *        that were drawn but not read back because consumers held every
+ *        pooled read back buffer.
+ */
+struct compositor_stages_t
+{
+    stage_timer upload;
+    stage_timer draw;
+    stage_timer readback;
+    stage_timer encode;
+    uint64_t    dropped = 0;
+};
+
+/**
+ * \brief Pixel layout of a composited frame as read back.
+ *
+ *        COMPOSITOR_PIXELS_RGBA8    - 8 bits per channel
+ *        COMPOSITOR_PIXELS_LUMA8    - one byte per pixel, for all-y8 manifests
+ *        COMPOSITOR_PIXELS_RGB10_A2 - GL_UNSIGNED_INT_2_10_10_10_REV words
+ *        COMPOSITOR_PIXELS_RGBA16F  - half float per channel
+ *        COMPOSITOR_PIXELS_RGBA32F  - float per channel, where the driver
+ *                                     doesn't read back half floats
+ *        COMPOSITOR_PIXELS_NV12     - a Y plane of two thirds of the rows,
+ *                                     then interleaved U and V for 2x2
+ *                                     pixels, always top row first; a row
+ *                                     is as many bytes as the frame is wide
+ */
+enum compositor_pixels_t
+{
+    COMPOSITOR_PIXELS_RGBA8 = 0,
+    COMPOSITOR_PIXELS_LUMA8,
+    COMPOSITOR_PIXELS_RGB10_A2,
+    COMPOSITOR_PIXELS_RGBA16F,
+    COMPOSITOR_PIXELS_RGBA32F,
+    COMPOSITOR_PIXELS_NV12,
+};
+
+/**
+ * \brief One composited frame, bottom row first as GL reads it back unless
+ *        the manifest asked for a top_down orientation. frame_id numbers
+ *        read backs from 0 in the order they were drawn, however much later
+ *        a frame arrives. data points into buffer, a pooled read back buffer,
+ *        and stays valid for as long as any copy of the frame is kept; the
+ *        buffer goes back to the pool once the last one is released.
+ */
+struct compositor_frame_t
+{
+    uint64_t             frame_id;
+    compositor_pixels_t  pixels;
+    const unsigned char *data;
+    size_t               row_bytes;
+    size_t               rows;
+    bool                 top_down;
+    readback_buffer      buffer;
+};
+
+typedef std::function<void(const compositor_frame_t &frame)> compositor_frame_callback_t;
+
+struct nv12_image_t;
+
+/**
+ * \brief Copies a COMPOSITOR_PIXELS_NV12 frame into the planes of an image,
+ *        reusing their storage.
+ *
+ * @param frame
+ * @param image [out]
+ * @return false if the frame isn't NV12
+ */
+bool compositor_frame_to_nv12(const compositor_frame_t &frame, nv12_image_t &image);
+
+/**
+ * \brief One stitching engine: its streams, their ingest threads, and the
+ *        textures, programs and render targets it draws them with.
+ *
+ * A compositor belongs to the GL context that was current when it was
+ * initialised; every call, including its destruction, must be made with that
+ * context current, until context_lost() hands it to a new one. Compositors
+ * on different contexts share nothing, so they can run in parallel, one per
+ * thread.
+ */
+class compositor {
+public:
+    compositor();
+    ~compositor();
+
+    /**
+     * \brief Opens the streams of a manifest.
+     *
+     * @param manifest_path
+     * @return false if the manifest can't be loaded or none of its streams
+     *         could be opened
+     */
+    bool                 init(const std::string &manifest_path);
+
+    /**
+     * \brief Opens the single recording the app ships to the device, in a
+     *        2x2 grid, for when there is no manifest.
+     *
+     * @return false if the recording can't be opened
+     */
+    bool                 init_default();
+
+    /**
+     * \brief Forgets every GL object without deleting it, once the context
+     *        the compositor was initialised on has been destroyed, e.g. when a
+     *        GLSurfaceView is paused. The streams are closed; call init() and
+     *        resize() on the new context next. Needs no current context.
+     */
+    void                 context_lost();
+
+    /**
+     * \brief Builds the program tiles are drawn with.
+     *
+     * @param vertex_source - NULL for the default pass-through shader
+     * @param fragment_source - NULL for the default pass-through shader
+     * @return false if the program doesn't compile or link
+     */
+    bool                 load_shader(const char *vertex_source, const char *fragment_source);
+
+    /**
+     * \brief Sets the size of the default framebuffer, i.e. of the window or
+     *        pbuffer the context draws to.
+     *
+     * @param width
+     * @param height
+     * @return
+     */
+    bool                 resize(int width, int height);
+
+    /**
+     * \brief Uploads whatever frames are ready, redraws the tiles they changed
+     *        and reads the result back, to be written out on the encode
+     *        thread while the next frame is drawn.
+     *
+     * @return false if no stream had a new frame ready
+     */
+    bool                 render();
+
+    /**
+     * \brief Returns true once every stream has been read to its end and all
+     *        its frames were drawn.
+     * @return
+     */
+    bool                 finished() const;
+
+    /**
+     * \brief Waits until every frame read back so far has been written out,
+     *        e.g. before the output is used or throughput is measured.
+     */
+    void                 flush();
+
+    /**
+     * \brief Whether stream containers are played at their recorded rate, as
+     *        for display, or read as fast as they are drawn. Takes effect from
+     *        the next init().
+     *
+     * @param paced - true by default
+     */
+    void                 set_paced(bool paced);
+
+    /**
+     * \brief Passes every composited frame to a callback, in order, before it
+     *        is written to the output. The callback runs on the encode thread;
+     *        when the manifest reads back through pack buffers, a frame
+     *        reaches it a tick or two after it was drawn.
+     *
+     * @param callback - empty to remove it
+     */
+    void                 set_frame_callback(const compositor_frame_callback_t &callback);
+
+    /**
+     * \brief Keeps the latest composited frames for a consumer to pull,
+     *        once the callback has seen them. When the consumer falls
+     *        behind, the oldest frame is dropped. May be called from any
+     *        thread; the new depth takes effect at the start of the next
+     *        render(), and frames still kept then are dropped.
+     *
+     * @param depth - frames kept at most; 0, the default, keeps none
+     */
+    void                 set_pull_queue(size_t depth);
+
+    /**
+     * \brief Takes the oldest frame kept for the consumer, without waiting.
+     *        May be called from any thread. The frame holds its buffer until
+     *        it is destroyed or its buffer released, which should be soon:
+     *        the pool only has a few frames to spare. While consumers hold
+     *        every spare buffer, frames are dropped before they are read back,
+     *        also for the output file and the callback, and counted in
+     *        stages().dropped.
+     *
+     * @param frame - receives the frame
+     * @return false if no frame is waiting
+     */
+    bool                 pull_frame(compositor_frame_t &frame);
+
+    /**
+     * \brief Appends every composited frame to a file, raw and top row first,
+     *        in the read back format: RGBA8, luminance for all-y8 manifests, or
+     *        the manifest's deep or NV12 format. Without one, frames are dumped as
+     *        images for inspection on the device where OpenCV is available.
+     *        Frames dropped because pulled frames are held too long, see
+     *        pull_frame(), are missing from the file.
+     *
+     * @param path - empty to stop writing
+     * @return false if the file can't be created
+     */
+    bool                 set_output(const std::string &path);
+
+    /**
+     * \brief Gets the per-stage timers, which the caller may reset.
+     * @return
+     */
+    compositor_stages_t &stages();
+
+private:
+    class impl;
+
+    // Data members
+    std::unique_ptr<impl> m_impl;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_COMPOSITOR_H
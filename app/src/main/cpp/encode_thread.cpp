@@ -0,0 +1,183 @@
+//--------------------------------------------------------------------------------------
+// File: encode_thread.cpp
+// Desc: Consumer thread that encodes and writes read back frames behind the GL thread.
+//--------------------------------------------------------------------------------------
+#include "encode_thread.h"
+#include "log_sink.h"
+
+
+#define LOG_TAG    "encode_thread.cpp"
+
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+
+// Polls that only yield the core before a waiting side goes to sleep, so a
+// short wait stays off the mutex and a long one costs no wakeups.
+static const unsigned YIELD_SPINS = 64;
+
+// Returns once ready() holds, sleeping on wake with parked raised if polling
+// doesn't get there. The fence pairs with the one in wake_parked(): either
+// the waker sees parked raised, or ready() sees what the waker changed.
+template <typename Ready>
+static void wait_until(const Ready &ready, std::atomic<bool> &parked, std::mutex &mutex,
+                       std::condition_variable &wake)
+{
+    for (unsigned spins = 0; spins < YIELD_SPINS; ++spins)
+    {
+        if (ready())
+        {
+            return;
+        }
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake.wait(lock, ready);
+    parked.store(false, std::memory_order_relaxed);
+}
+
+// Wakes the side sleeping in wait_until() on parked, if it is, after the
+// caller changed what that side waits for.
+static void wake_parked(std::atomic<bool> &parked, std::mutex &mutex, std::condition_variable &wake)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+}
+
+encode_thread::encode_thread()
+    : m_stop(false),
+      m_encoder_parked(false),
+      m_caller_parked(false),
+      m_submit_count(0),
+      m_encode_count(0),
+      m_stalls(0)
+{
+}
+
+encode_thread::~encode_thread()
+{
+    stop();
+}
+
+bool encode_thread::start(const encode_sink_t &sink, size_t depth)
+{
+    if (m_thread.joinable() || depth == 0)
+    {
+        return false;
+    }
+
+    m_frames.resize(depth);
+    m_free.reset(new spsc_queue<encode_frame_t *>(depth));
+    m_submitted.reset(new spsc_queue<encode_frame_t *>(depth));
+    for (size_t i = 0; i < depth; ++i)
+    {
+        m_free->try_push(&m_frames[i]);
+    }
+    m_sink         = sink;
+    m_submit_count = 0;
+    m_encode_count = 0;
+    m_stalls       = 0;
+    m_encode.reset();
+    m_stop         = false;
+    m_thread       = std::thread(&encode_thread::run, this);
+    return true;
+}
+
+void encode_thread::stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    m_stop = true;
+    wake_parked(m_encoder_parked, m_wake_mutex, m_wake);
+    m_thread.join();
+    if (m_stalls)
+    {
+        DPRINTF1("encoder made the GL thread wait %llu times in %llu frames", (unsigned long long) m_stalls,
+                 (unsigned long long) m_submit_count);
+    }
+}
+
+bool encode_thread::running() const
+{
+    return m_thread.joinable();
+}
+
+encode_frame_t *encode_thread::acquire()
+{
+    if (!m_thread.joinable())
+    {
+        return NULL;
+    }
+
+    encode_frame_t *frame = NULL;
+    if (m_free->try_pop(frame))
+    {
+        return frame;
+    }
+    ++m_stalls;
+    while (!m_free->try_pop(frame))
+    {
+        wait_until([this] { return !m_free->empty(); }, m_caller_parked, m_wake_mutex, m_wake);
+    }
+    return frame;
+}
+
+void encode_thread::submit(encode_frame_t *frame)
+{
+    ++m_submit_count;
+    // Never full: there are only as many frames as the queue holds.
+    m_submitted->try_push(frame);
+    wake_parked(m_encoder_parked, m_wake_mutex, m_wake);
+}
+
+void encode_thread::flush()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    wait_until([this] { return m_encode_count.load(std::memory_order_acquire) == m_submit_count; },
+               m_caller_parked, m_wake_mutex, m_wake);
+}
+
+stage_timer &encode_thread::encode()
+{
+    return m_encode;
+}
+
+uint64_t encode_thread::stalls() const
+{
+    return m_stalls;
+}
+
+void encode_thread::run()
+{
+    for (;;)
+    {
+        encode_frame_t *frame = NULL;
+        if (!m_submitted->try_pop(frame))
+        {
+            // Everything submitted before stop() was set has been popped by now.
+            if (m_stop.load(std::memory_order_acquire) && m_submitted->empty())
+            {
+                break;
+            }
+            wait_until([this] { return !m_submitted->empty() || m_stop.load(std::memory_order_acquire); },
+                       m_encoder_parked, m_wake_mutex, m_wake);
+            continue;
+        }
+        m_encode.begin();
+        m_sink(*frame);
+        m_encode.end();
+        frame->buffer.release();
+        m_free->try_push(frame);
+        m_encode_count.fetch_add(1, std::memory_order_release);
+        wake_parked(m_caller_parked, m_wake_mutex, m_wake);
+    }
+}
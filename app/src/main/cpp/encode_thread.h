@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// File: encode_thread.h
+// Desc: Consumer thread that encodes and writes read back frames behind the GL thread.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_ENCODE_THREAD_H
+#define ANDROID_SHADER_DEMO_JNI_ENCODE_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "readback_pool.h"
+#include "spsc_queue.h"
+#include "stage_timer.h"
+
+/**
+ * \brief One read back frame on its way to the encoder. Its pixels live in a
+ *        pooled buffer, which the encode thread releases once the sink has
+ *        run; the sink may keep copies of the handle for longer.
+ */
+struct encode_frame_t
+{
+    readback_buffer            buffer;
+    size_t                     row_bytes;
+    size_t                     rows;
+    // What the rows hold and which frame they are, as defined by whoever
+    // submits and encodes them.
+    uint32_t                   kind;
+    uint64_t                   frame_index;
+    // Rows are stored top row first rather than bottom row first, as GL
+    // reads them back.
+    bool                       top_down;
+};
+
+/**
+ * \brief Called on the encode thread for every submitted frame, in order.
+ */
+typedef std::function<void(const encode_frame_t &frame)> encode_sink_t;
+
+/**
+ * \brief Runs the last stage of the pipeline, e.g. writing frames to a file or
+ *        compressing them, on its own thread.
+ *
+ * The GL thread acquires a free frame, fills it with a read back and submits
+ * it, then moves on to the next tick while the sink consumes the frame. Frames
+ * travel in a fixed pool between two lock-free queues, submitted and free, so
+ * neither side takes a lock while frames flow. When every frame is queued for
+ * the sink, acquire() waits: frames are never dropped on the way to the output.
+ * Frames the compositor drops before reading them back, see
+ * compositor::pull_frame(), never reach the encode thread.
+ * A side that has waited for a while, e.g. the encode thread while nothing is
+ * read back, sleeps on a condition variable until the other side wakes it.
+ */
+class encode_thread {
+public:
+    encode_thread();
+
+    /**
+     * \brief Stops the thread, if running.
+     */
+    ~encode_thread();
+
+    /**
+     * \brief Starts consuming frames.
+     *
+     * @param sink
+     * @param depth - Number of frames that may wait for the sink
+     * @return false if already running
+     */
+    bool            start(const encode_sink_t &sink, size_t depth);
+
+    /**
+     * \brief Lets the sink finish every submitted frame, then joins the thread.
+     */
+    void            stop();
+
+    bool            running() const;
+
+    /**
+     * \brief Gets a free frame to fill, waiting for the sink if all are taken.
+     * @return the frame, or NULL if not running
+     */
+    encode_frame_t *acquire();
+
+    /**
+     * \brief Queues a frame from acquire() for the sink.
+     * @param frame
+     */
+    void            submit(encode_frame_t *frame);
+
+    /**
+     * \brief Waits until the sink has finished every submitted frame, e.g.
+     *        before the output is closed or timed.
+     */
+    void            flush();
+
+    /**
+     * \brief Time the sink took per frame. Read it only after flush() or stop().
+     * @return
+     */
+    stage_timer    &encode();
+
+    /**
+     * \brief Number of times acquire() had to wait, i.e. the sink was the
+     *        slowest stage.
+     * @return
+     */
+    uint64_t        stalls() const;
+
+private:
+    void            run();
+
+    // Data members
+    std::vector<encode_frame_t>                    m_frames;
+    std::unique_ptr<spsc_queue<encode_frame_t *> > m_free;
+    std::unique_ptr<spsc_queue<encode_frame_t *> > m_submitted;
+    encode_sink_t                                  m_sink;
+    std::thread                                    m_thread;
+    std::atomic<bool>                              m_stop;
+    // Raised while the encode thread, or the thread submitting, sleeps on
+    // m_wake; the other side only takes m_wake_mutex to wake it then.
+    std::atomic<bool>                              m_encoder_parked;
+    std::atomic<bool>                              m_caller_parked;
+    std::mutex                                     m_wake_mutex;
+    std::condition_variable                        m_wake;
+    // Frames submitted, by the GL thread, and encoded, by the encode thread.
+    uint64_t                                       m_submit_count;
+    std::atomic<uint64_t>                          m_encode_count;
+    uint64_t                                       m_stalls;
+    stage_timer                                    m_encode;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_ENCODE_THREAD_H
@@ -0,0 +1,130 @@
+//--------------------------------------------------------------------------------------
+// File: frame_ring.cpp
+// Desc: Bounded ring of preallocated frame buffers shared by a producer and a consumer.
+//--------------------------------------------------------------------------------------
+#include "frame_ring.h"
+
+#include <cstring>
+
+frame_ring::frame_ring(size_t slot_count, size_t slot_bytes, ring_policy_t policy, unsigned char *const *slot_data)
+    : m_policy(policy),
+      m_storage(slot_data ? 0 : slot_count * slot_bytes),
+      m_slots(slot_count),
+      m_states(slot_count, SLOT_FREE),
+      m_write_pos(0),
+      m_read_pos(0),
+      m_closed(false)
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+    for (size_t i = 0; i < slot_count; ++i)
+    {
+        m_slots[i].data        = slot_data ? slot_data[i] : m_storage.data() + i * slot_bytes;
+        m_slots[i].capacity    = slot_bytes;
+        m_slots[i].bytes       = 0;
+        m_slots[i].frame_index = 0;
+        m_slots[i].slot_id     = i;
+    }
+}
+
+size_t frame_ring::slot_index(const frame_slot_t *slot) const
+{
+    return static_cast<size_t>(slot - m_slots.data());
+}
+
+frame_slot_t *frame_ring::acquire_write()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_slots.empty())
+    {
+        return NULL;
+    }
+
+    // Slots are filled strictly in ring order, so when the next one is still
+    // ready it is also the oldest frame the consumer hasn't taken.
+    const size_t pos = m_write_pos;
+    m_slot_freed.wait(lock, [this, pos]
+    {
+        return m_closed
+               || m_states[pos] == SLOT_FREE
+               || (m_policy == RING_POLICY_DROP_OLDEST && m_states[pos] == SLOT_READY);
+    });
+    if (m_closed)
+    {
+        return NULL;
+    }
+
+    if (m_states[pos] == SLOT_READY)
+    {
+        ++m_stats.dropped;
+        m_read_pos = (pos + 1) % m_slots.size();
+    }
+    m_states[pos] = SLOT_WRITING;
+    m_write_pos   = (pos + 1) % m_slots.size();
+    return &m_slots[pos];
+}
+
+void frame_ring::commit_write(frame_slot_t *slot)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_states[slot_index(slot)] = SLOT_READY;
+    ++m_stats.produced;
+}
+
+frame_slot_t *frame_ring::try_acquire_read()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_slots.empty() || m_states[m_read_pos] != SLOT_READY)
+    {
+        if (!m_closed)
+        {
+            ++m_stats.underruns;
+        }
+        return NULL;
+    }
+
+    const size_t pos = m_read_pos;
+    m_states[pos] = SLOT_READING;
+    m_read_pos    = (pos + 1) % m_slots.size();
+    ++m_stats.consumed;
+    return &m_slots[pos];
+}
+
+void frame_ring::release_read(frame_slot_t *slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_states[slot_index(slot)] = SLOT_FREE;
+    }
+    m_slot_freed.notify_one();
+}
+
+void frame_ring::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_slot_freed.notify_all();
+}
+
+bool frame_ring::drained() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_closed && (m_slots.empty() || m_states[m_read_pos] != SLOT_READY);
+}
+
+ring_policy_t frame_ring::policy() const
+{
+    return m_policy;
+}
+
+size_t frame_ring::slot_count() const
+{
+    return m_slots.size();
+}
+
+ring_stats_t frame_ring::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
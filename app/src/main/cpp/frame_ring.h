@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// File: frame_ring.h
+// Desc: Bounded ring of preallocated frame buffers shared by a producer and a consumer.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_FRAME_RING_H
+#define ANDROID_SHADER_DEMO_JNI_FRAME_RING_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * \brief What the producer does when every slot holds a frame the consumer
+ *        hasn't taken yet.
+ *
+ *        RING_POLICY_BLOCK       - wait until the consumer frees a slot.
+ *        RING_POLICY_DROP_OLDEST - overwrite the oldest ready frame.
+ */
+enum ring_policy_t
+{
+    RING_POLICY_BLOCK = 0,
+    RING_POLICY_DROP_OLDEST,
+};
+
+/**
+ * \brief One preallocated frame buffer in a frame_ring. slot_id is the slot's
+ *        fixed position in its ring, e.g. to find a buffer object backing it.
+ */
+struct frame_slot_t
+{
+    unsigned char *data;
+    size_t         capacity;
+    size_t         bytes;
+    size_t         frame_index;
+    size_t         slot_id;
+};
+
+/**
+ * \brief Counters kept by a frame_ring. An underrun is a read attempt that
+ *        found no ready frame while the producer was still running; a drop is
+ *        a ready frame overwritten under RING_POLICY_DROP_OLDEST.
+ */
+struct ring_stats_t
+{
+    uint64_t produced;
+    uint64_t consumed;
+    uint64_t dropped;
+    uint64_t underruns;
+};
+
+/**
+ * \brief A fixed-size ring of frame buffers for one producer and one consumer.
+ *
+ * All buffers are allocated up front. Frames are handed out in the order they
+ * were committed, and the consumer may hold several frames at once as long as
+ * it releases each one when done with it.
+ */
+class frame_ring {
+public:
+    /**
+     * \brief Allocates slot_count buffers of slot_bytes each, or uses the given
+     *        ones.
+     *
+     * With slot_data the ring owns no memory. A consumer may then point a slot
+     * it holds at another buffer before releasing it, e.g. a buffer object
+     * that was mapped again after the GPU finished reading it.
+     *
+     * @param slot_count
+     * @param slot_bytes
+     * @param policy
+     * @param slot_data - slot_count buffers of slot_bytes each, or NULL
+     */
+    frame_ring(size_t slot_count, size_t slot_bytes, ring_policy_t policy, unsigned char *const *slot_data = NULL);
+
+    /**
+     * \brief Gets a free slot to write the next frame into, waiting or dropping
+     *        according to the ring's policy.
+     * @return the slot, or NULL once the ring is closed
+     */
+    frame_slot_t  *acquire_write();
+
+    /**
+     * \brief Publishes a slot obtained from acquire_write() to the consumer.
+     * @param slot
+     */
+    void           commit_write(frame_slot_t *slot);
+
+    /**
+     * \brief Takes the oldest ready frame without waiting.
+     * @return the slot, or NULL if no frame is ready
+     */
+    frame_slot_t  *try_acquire_read();
+
+    /**
+     * \brief Returns a slot obtained from try_acquire_read() to the producer.
+     * @param slot
+     */
+    void           release_read(frame_slot_t *slot);
+
+    /**
+     * \brief Tells both sides no more frames will be written and wakes a
+     *        blocked producer. Frames already ready can still be read.
+     */
+    void           close();
+
+    /**
+     * \brief Returns true once the ring is closed and every ready frame was read.
+     * @return
+     */
+    bool           drained() const;
+
+    ring_policy_t  policy() const;
+    size_t         slot_count() const;
+    ring_stats_t   stats() const;
+
+private:
+    enum slot_state_t
+    {
+        SLOT_FREE = 0,
+        SLOT_WRITING,
+        SLOT_READY,
+        SLOT_READING,
+    };
+
+    size_t         slot_index(const frame_slot_t *slot) const;
+
+    // Data members
+    const ring_policy_t        m_policy;
+    std::vector<unsigned char> m_storage;
+    std::vector<frame_slot_t>  m_slots;
+    std::vector<slot_state_t>  m_states;
+    size_t                     m_write_pos;
+    size_t                     m_read_pos;
+    bool                       m_closed;
+    ring_stats_t               m_stats;
+    mutable std::mutex         m_mutex;
+    std::condition_variable    m_slot_freed;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_FRAME_RING_H
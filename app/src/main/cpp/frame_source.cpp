@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------------
+// File: frame_source.cpp
+// Desc: Frame sources that hand the compositor a pointer to each raw input frame.
+//--------------------------------------------------------------------------------------
+#include "frame_source.h"
+#include "log_sink.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define LOG_TAG    "frame_source.cpp"
+
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+// Frames prefetched past the read position unless set_readahead() says otherwise.
+static const size_t DEFAULT_READAHEAD_FRAMES = 3;
+
+uint32_t packed_row_bytes(uint32_t width, pixel_format_t pixel_format)
+{
+    switch (pixel_format)
+    {
+        case PIXEL_FORMAT_RGB24:
+            return width * 3;
+        case PIXEL_FORMAT_NV12:
+        case PIXEL_FORMAT_Y8:
+            return width;
+        case PIXEL_FORMAT_MIPI10:
+            return width / 4 * 5;
+        case PIXEL_FORMAT_P010:
+            return width * 2;
+        case PIXEL_FORMAT_TP10:
+            return width / 3 * 4;
+    }
+    return 0;
+}
+
+uint32_t frame_rows(const frame_format_t &format)
+{
+    switch (format.pixel_format)
+    {
+        case PIXEL_FORMAT_RGB24:
+        case PIXEL_FORMAT_Y8:
+        case PIXEL_FORMAT_MIPI10:
+            return format.height;
+        case PIXEL_FORMAT_NV12:
+        case PIXEL_FORMAT_P010:
+        case PIXEL_FORMAT_TP10:
+            return format.height + format.height / 2;
+    }
+    return 0;
+}
+
+frame_format_t make_frame_format(uint32_t width, uint32_t height, pixel_format_t pixel_format)
+{
+    frame_format_t format;
+    format.width        = width;
+    format.height       = height;
+    format.stride       = packed_row_bytes(width, pixel_format);
+    format.pixel_format = pixel_format;
+    format.fps          = 0.0;
+    return format;
+}
+
+const char *frame_format_error(uint32_t width, uint32_t height, pixel_format_t pixel_format)
+{
+    if (width == 0 || height == 0)
+    {
+        return "a frame needs a nonzero width and height";
+    }
+    switch (pixel_format)
+    {
+        case PIXEL_FORMAT_RGB24:
+        case PIXEL_FORMAT_Y8:
+            break;
+        case PIXEL_FORMAT_NV12:
+            if (width % 2 || height % 2)
+            {
+                return "nv12 needs an even width and height";
+            }
+            break;
+        case PIXEL_FORMAT_P010:
+            if (width % 2 || height % 2)
+            {
+                return "p010 needs an even width and height";
+            }
+            break;
+        case PIXEL_FORMAT_TP10:
+            if (width % 6 || height % 2)
+            {
+                return "tp10 needs a width divisible by 6 and an even height";
+            }
+            break;
+        case PIXEL_FORMAT_MIPI10:
+            if (width % 4 || height % 2)
+            {
+                return "mipi10 needs a width divisible by 4 and an even height";
+            }
+            break;
+    }
+    return NULL;
+}
+
+size_t frame_bytes(const frame_format_t &format)
+{
+    return static_cast<size_t>(format.stride) * frame_rows(format);
+}
+
+size_t packed_frame_bytes(const frame_format_t &format)
+{
+    return static_cast<size_t>(packed_row_bytes(format.width, format.pixel_format)) * frame_rows(format);
+}
+
+void copy_packed_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format)
+{
+    const size_t row_bytes = packed_row_bytes(format.width, format.pixel_format);
+    if (row_bytes == format.stride)
+    {
+        std::memcpy(dst, src, frame_bytes(format));
+        return;
+    }
+    for (uint32_t y = 0; y < frame_rows(format); ++y)
+    {
+        std::memcpy(dst + y * row_bytes, src + static_cast<size_t>(y) * format.stride, row_bytes);
+    }
+}
+
+mapped_frame_source::mapped_frame_source()
+    : m_map(NULL),
+      m_map_size(0),
+      m_format(make_frame_format(0, 0, PIXEL_FORMAT_RGB24)),
+      m_frame_bytes(0),
+      m_frame_count(0),
+      m_position(0),
+      m_readahead(DEFAULT_READAHEAD_FRAMES)
+{
+}
+
+mapped_frame_source::~mapped_frame_source()
+{
+    close();
+}
+
+bool mapped_frame_source::map_file(const std::string &filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        EPRINTF1("Error %d opening %s : %s", errno, filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        EPRINTF1("Can't map empty or unreadable file %s", filename.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        EPRINTF1("Error %d mapping %s : %s", errno, filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_map      = static_cast<unsigned char *>(map);
+    m_map_size = static_cast<size_t>(st.st_size);
+    madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool mapped_frame_source::open(const std::string &filename, const frame_format_t &format)
+{
+    if (!map_file(filename))
+    {
+        return false;
+    }
+
+    m_format      = format;
+    m_frame_bytes = frame_bytes(format);
+    m_frame_count = m_frame_bytes ? m_map_size / m_frame_bytes : 0;
+    if (m_frame_count == 0)
+    {
+        EPRINTF1("%s holds no complete %ux%u frame", filename.c_str(), format.width, format.height);
+        close();
+        return false;
+    }
+    if (m_map_size % m_frame_bytes)
+    {
+        DPRINTF1("%s has %zu trailing bytes after the last frame", filename.c_str(), m_map_size % m_frame_bytes);
+    }
+
+    DPRINTF1("mapped %s: %zu frames of %ux%u", filename.c_str(), m_frame_count, format.width, format.height);
+    seek(0);
+    return true;
+}
+
+void mapped_frame_source::close()
+{
+    if (m_map)
+    {
+        munmap(m_map, m_map_size);
+    }
+    m_map         = NULL;
+    m_map_size    = 0;
+    m_frame_bytes = 0;
+    m_frame_count = 0;
+    m_position    = 0;
+}
+
+bool mapped_frame_source::is_open() const
+{
+    return m_map != NULL;
+}
+
+void mapped_frame_source::set_readahead(size_t frames)
+{
+    m_readahead = frames;
+}
+
+const frame_format_t &mapped_frame_source::format() const
+{
+    return m_format;
+}
+
+size_t mapped_frame_source::frame_count() const
+{
+    return m_frame_count;
+}
+
+size_t mapped_frame_source::position() const
+{
+    return m_position;
+}
+
+size_t mapped_frame_source::frame_offset(size_t index) const
+{
+    return index * m_frame_bytes;
+}
+
+const unsigned char *mapped_frame_source::frame_data(size_t index) const
+{
+    if (!m_map || index >= m_frame_count)
+    {
+        return NULL;
+    }
+    return m_map + frame_offset(index);
+}
+
+void mapped_frame_source::advise_frames(size_t first, size_t count, int advice) const
+{
+    if (!m_map || first >= m_frame_count || count == 0)
+    {
+        return;
+    }
+    const size_t last = std::min(first + count, m_frame_count) - 1;
+
+    // madvise() wants a page-aligned start address. Pages shared with a
+    // neighbouring frame are only ever prefetched, never dropped.
+    const size_t page  = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t       begin = frame_offset(first) / page * page;
+    size_t       end   = std::min(frame_offset(last) + m_frame_bytes, m_map_size);
+    if (advice == MADV_DONTNEED)
+    {
+        begin = (frame_offset(first) + page - 1) / page * page;
+        end   = end / page * page;
+    }
+    if (end > begin)
+    {
+        madvise(m_map + begin, end - begin, advice);
+    }
+}
+
+bool mapped_frame_source::seek(size_t index)
+{
+    if (index > m_frame_count)
+    {
+        return false;
+    }
+    m_position = index;
+    advise_frames(m_position, m_readahead + 1, MADV_WILLNEED);
+    return true;
+}
+
+const unsigned char *mapped_frame_source::next_frame()
+{
+    const unsigned char *frame = frame_data(m_position);
+    if (!frame)
+    {
+        return NULL;
+    }
+
+    // The previous frame is no longer referenced by the caller; give its pages
+    // back so long recordings don't grow the resident set.
+    if (m_position > 0)
+    {
+        advise_frames(m_position - 1, 1, MADV_DONTNEED);
+    }
+    advise_frames(m_position + 1, m_readahead, MADV_WILLNEED);
+
+    ++m_position;
+    return frame;
+}
@@ -0,0 +1,235 @@
+//--------------------------------------------------------------------------------------
+// File: frame_source.h
+// Desc: Frame sources that hand the compositor a pointer to each raw input frame.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_FRAME_SOURCE_H
+#define ANDROID_SHADER_DEMO_JNI_FRAME_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * \brief Pixel layouts a frame source can deliver.
+ *
+ *        PIXEL_FORMAT_RGB24 - packed 8-bit R, G, B
+ *        PIXEL_FORMAT_NV12  - 8-bit Y plane followed by a half-height plane of
+ *                             interleaved U, V at half horizontal resolution
+ *        PIXEL_FORMAT_Y8    - 8-bit luminance only, e.g. the Y plane of a YUV frame
+ *        PIXEL_FORMAT_MIPI10 - BGGR Bayer samples in MIPI RAW10 packing, 5 bytes
+ *                             per 4 samples (see bayer_mipi10_image_t)
+ *        PIXEL_FORMAT_P010  - NV12 layout with 16-bit little-endian samples
+ *                             holding 10 bits in their most significant bits
+ *        PIXEL_FORMAT_TP10  - NV12 layout with three 10-bit samples packed
+ *                             into each 32-bit little-endian word, lowest
+ *                             bits first
+ */
+enum pixel_format_t
+{
+    PIXEL_FORMAT_RGB24 = 0,
+    PIXEL_FORMAT_NV12,
+    PIXEL_FORMAT_Y8,
+    PIXEL_FORMAT_MIPI10,
+    PIXEL_FORMAT_P010,
+    PIXEL_FORMAT_TP10,
+};
+
+/**
+ * \brief Geometry and layout of every frame in a source. stride is the number
+ *        of bytes between the starts of two consecutive rows, in every plane.
+ */
+struct frame_format_t
+{
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       stride;
+    pixel_format_t pixel_format;
+    double         fps;
+};
+
+/**
+ * \brief Returns the number of bytes in one unpadded row of the first plane.
+ *        Every later plane uses rows of the same length.
+ * @param width
+ * @param pixel_format
+ * @return
+ */
+uint32_t packed_row_bytes(uint32_t width, pixel_format_t pixel_format);
+
+/**
+ * \brief Returns the number of rows across all planes of one frame.
+ * @param format
+ * @return
+ */
+uint32_t frame_rows(const frame_format_t &format);
+
+/**
+ * \brief Builds a tightly packed frame_format_t for the given dimensions.
+ * @param width
+ * @param height
+ * @param pixel_format
+ * @return
+ */
+frame_format_t make_frame_format(uint32_t width, uint32_t height, pixel_format_t pixel_format);
+
+/**
+ * \brief Checks that frames of the given dimensions can be stored in the
+ *        given pixel format: neither dimension is 0 and both are whole
+ *        multiples of the format's subsampling and packing.
+ * @param width
+ * @param height
+ * @param pixel_format
+ * @return NULL if they can, else what the format needs
+ */
+const char *frame_format_error(uint32_t width, uint32_t height, pixel_format_t pixel_format);
+
+/**
+ * \brief Returns the number of bytes one frame of the given format occupies.
+ * @param format
+ * @return
+ */
+size_t frame_bytes(const frame_format_t &format);
+
+/**
+ * \brief Returns the number of bytes one frame occupies once row padding is removed.
+ * @param format
+ * @return
+ */
+size_t packed_frame_bytes(const frame_format_t &format);
+
+/**
+ * \brief Copies one frame, dropping any padding between rows.
+ * @param dst - Must hold packed_frame_bytes(format) bytes
+ * @param src - A frame laid out as described by format
+ * @param format
+ */
+void copy_packed_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format);
+
+/**
+ * \brief Sequential source of raw frames with random access by frame index.
+ *
+ * The pointer returned by next_frame() stays valid until the next call to
+ * next_frame() or seek() on the same source.
+ */
+class frame_source {
+public:
+    virtual ~frame_source() {}
+
+    /**
+     * \brief Gets the format shared by all frames of the source.
+     * @return
+     */
+    virtual const frame_format_t &format() const = 0;
+
+    /**
+     * \brief Gets the total number of frames in the source.
+     * @return
+     */
+    virtual size_t                frame_count() const = 0;
+
+    /**
+     * \brief Gets the index of the frame next_frame() will return.
+     * @return
+     */
+    virtual size_t                position() const = 0;
+
+    /**
+     * \brief Moves the read position to the given frame index.
+     * @param index
+     * @return false if index is past the end of the source
+     */
+    virtual bool                  seek(size_t index) = 0;
+
+    /**
+     * \brief Returns the frame at the read position and advances it.
+     * @return the frame data, or NULL at the end of the source
+     */
+    virtual const unsigned char  *next_frame() = 0;
+};
+
+/**
+ * \brief A frame_source over a memory-mapped file of back-to-back raw frames.
+ *
+ * Frames are returned as pointers straight into the mapping, so they can be
+ * handed to glTexImage2D without an intermediate copy. The kernel is asked to
+ * read ahead the next few frames and to drop the ones already consumed.
+ */
+class mapped_frame_source : public frame_source {
+public:
+    mapped_frame_source();
+
+    /**
+     * \brief Unmaps the file, if one is open.
+     */
+    ~mapped_frame_source();
+
+    /**
+     * \brief Maps a headerless recording whose frames all have the given format.
+     *
+     * @param filename
+     * @param format
+     * @return false if the file can't be mapped or holds no complete frame
+     */
+    bool                  open(const std::string &filename, const frame_format_t &format);
+
+    /**
+     * \brief Unmaps the file and resets the source.
+     */
+    void                  close();
+
+    bool                  is_open() const;
+
+    /**
+     * \brief Sets how many frames past the read position are prefetched.
+     * @param frames
+     */
+    void                  set_readahead(size_t frames);
+
+    /**
+     * \brief Gets a pointer to the given frame without moving the read position.
+     * @param index
+     * @return the frame data, or NULL if index is out of range
+     */
+    const unsigned char  *frame_data(size_t index) const;
+
+    const frame_format_t &format() const;
+    size_t                frame_count() const;
+    size_t                position() const;
+    bool                  seek(size_t index);
+    const unsigned char  *next_frame();
+
+protected:
+    /**
+     * \brief Maps the whole file read-only.
+     * @param filename
+     * @return
+     */
+    bool                  map_file(const std::string &filename);
+
+    /**
+     * \brief Gets the byte offset of the given frame within the mapping.
+     * @param index
+     * @return
+     */
+    virtual size_t        frame_offset(size_t index) const;
+
+    /**
+     * \brief Issues madvise() for the frames in [first, first + count).
+     * @param first
+     * @param count
+     * @param advice
+     */
+    void                  advise_frames(size_t first, size_t count, int advice) const;
+
+    // Data members
+    unsigned char  *m_map;
+    size_t          m_map_size;
+    frame_format_t  m_format;
+    size_t          m_frame_bytes;
+    size_t          m_frame_count;
+    size_t          m_position;
+    size_t          m_readahead;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_FRAME_SOURCE_H
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// File: gl2jni.cpp
+// Desc: JNI bindings of GL2JNILib, driving the compositor from GL2JNIView's
+//       renderer thread.
+//--------------------------------------------------------------------------------------
+#include <jni.h>
+#include <mutex>
+#include <vector>
+
+#include "compositor.h"
+
+static const char *const MANIFEST_PATH = "/storage/emulated/0/opencvTesting/streams.txt";
+
+// The view's compositor lives as long as the process, so frames pulled on
+// other threads stay valid. Every onSurfaceCreated() comes with a new context,
+// in which the old one's GL names mean nothing.
+static compositor *g_compositor = NULL;
+
+// Frames handed to Java by pullFrame() until releaseFrame(); each holds its
+// pooled buffer, which the returned direct ByteBuffer wraps. Java may pull on
+// any thread.
+static std::mutex                      g_held_mutex;
+static std::vector<compositor_frame_t> g_held_frames;
+
+// The pull queue depth Java asked for, which a compositor created later starts
+// with; guarded by g_held_mutex, as is setting g_compositor.
+static size_t g_pull_depth = 0;
+
+extern "C" {
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_init(JNIEnv *env, jobject obj, jobject bmp)
+{
+    if (!g_compositor)
+    {
+        std::lock_guard<std::mutex> lock(g_held_mutex);
+        g_compositor = new compositor();
+        g_compositor->set_pull_queue(g_pull_depth);
+    }
+    else
+    {
+        g_compositor->context_lost();
+    }
+    // Without a usable manifest the view shows the recording on the device.
+    if (!g_compositor->init(MANIFEST_PATH))
+    {
+        g_compositor->init_default();
+    }
+}
+
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_resize(JNIEnv *env, jobject obj, jint width, jint height)
+{
+    g_compositor->resize(width, height);
+}
+
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_step(JNIEnv *env, jobject obj)
+{
+    g_compositor->render();
+}
+
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_loadShader(JNIEnv *env, jobject obj, jstring vs, jstring fs)
+{
+    const char *vertex   = vs ? env->GetStringUTFChars(vs, NULL) : NULL;
+    const char *fragment = fs ? env->GetStringUTFChars(fs, NULL) : NULL;
+    g_compositor->load_shader(vertex, fragment);
+    if (vertex)
+    {
+        env->ReleaseStringUTFChars(vs, vertex);
+    }
+    if (fragment)
+    {
+        env->ReleaseStringUTFChars(fs, fragment);
+    }
+}
+
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_setPullQueue(JNIEnv *env, jobject obj, jint depth)
+{
+    std::lock_guard<std::mutex> lock(g_held_mutex);
+    g_pull_depth = depth > 0 ? depth : 0;
+    if (g_compositor)
+    {
+        g_compositor->set_pull_queue(g_pull_depth);
+    }
+    // Only grows, so once Java holds as many frames as it will pulling doesn't
+    // allocate.
+    g_held_frames.reserve(g_pull_depth);
+}
+
+JNIEXPORT jobject JNICALL Java_com_android_gl2jni_GL2JNILib_pullFrame(JNIEnv *env, jobject obj, jlongArray info)
+{
+    compositor_frame_t frame;
+    if (!g_compositor || !g_compositor->pull_frame(frame))
+    {
+        return NULL;
+    }
+    jobject pixels = env->NewDirectByteBuffer((void *) frame.data, frame.row_bytes * frame.rows);
+    if (!pixels)
+    {
+        return NULL;
+    }
+    if (info && env->GetArrayLength(info) >= 5)
+    {
+        const jlong fields[] = { (jlong) frame.frame_id, frame.pixels, (jlong) frame.row_bytes,
+                                 (jlong) frame.rows, frame.top_down };
+        env->SetLongArrayRegion(info, 0, 5, fields);
+    }
+    std::lock_guard<std::mutex> lock(g_held_mutex);
+    g_held_frames.push_back(std::move(frame));
+    return pixels;
+}
+
+JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_releaseFrame(JNIEnv *env, jobject obj, jobject pixels)
+{
+    const void *data = pixels ? env->GetDirectBufferAddress(pixels) : NULL;
+    std::lock_guard<std::mutex> lock(g_held_mutex);
+    for (size_t i = 0; i < g_held_frames.size(); ++i)
+    {
+        if (g_held_frames[i].data == data)
+        {
+            g_held_frames[i] = std::move(g_held_frames.back());
+            g_held_frames.pop_back();
+            return;
+        }
+    }
+}
+};
@@ -14,53 +14,62 @@
  * limitations under the License.
  */
 
-// OpenGL ES 2.0 code
+// OpenGL ES 2.0 code, with OpenGL ES 3.0 paths for high bit depth input
 
-#include <jni.h>
-#include <android/log.h>
-#include <android/bitmap.h>
+#include "log_sink.h"
 
-#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
 #include <GLES2/gl2ext.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <vector>
-#include "cl_code.h"
-#include "speckle_utils.h"
+#include "compositor.h"
+#include "encode_thread.h"
+#include "frame_source.h"
+#include "ingest_thread.h"
+#include "log_sink.h"
+#include "atlas_layout.h"
+#include "pack_buffer_ring.h"
+#include "pack_pass.h"
+#include "pixel_convert.h"
+#include "readback_pool.h"
+#include "render_target.h"
+#include "shader_program.h"
+#include "stage_timer.h"
+#include "tile_layout.h"
+#include "unpack_buffer_ring.h"
+#include "util.h"
+#include "stream_container.h"
+#include "stream_manifest.h"
 #define  LOG_TAG    "libgl2jni"
-#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
-#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#define  LOGI(...)  log_print(LOG_LEVEL_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+#define  DPRINTF(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+#ifdef HAVE_OPENCV
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/core/ocl.hpp"
-
-namespace abc {}
+#endif
 
 static void printGLString(const char *name, GLenum s) {
     const char *v = (const char *) glGetString(s);
     LOGI("GL %s = %s\n", name, v);
 }
 
-static void checkGlError(const char *op) {
-    for (GLint error = glGetError(); error; error = glGetError()) {
-        LOGI("after %s() glError (0x%x)\n", op, error);
-    }
-}
-
-inline unsigned char saturate_cast_uchar(float val) {
-    //val += 0.5; // to round the value
-    return static_cast<unsigned char>(val < 0 ? 0 : (val > 0xff ? 0xff : val));
-}
-
 
 
-auto gVertexShader =
-        "attribute vec4 aPosition;\n"
+static auto gVertexShader =
+        "attribute vec2 aPosition;\n"
             "attribute vec2 aTexCoord;\n"
             "varying vec2 vTexCoord;\n"
             "void main() {\n"
@@ -68,7 +77,7 @@ auto gVertexShader =
             "   vTexCoord = aTexCoord;\n"
             "}";
 
-auto gFragmentShader =
+static auto gFragmentShader =
         "precision mediump float;\n"
             "uniform sampler2D rubyTexture;\n"
             "varying vec2 vTexCoord;\n"
@@ -78,104 +87,554 @@ auto gFragmentShader =
             "}";
 
 
-GLuint loadShader(GLenum shaderType, const char *pSource) {
-    GLuint shader = glCreateShader(shaderType);
-    if (shader) {
-        glShaderSource(shader, 1, &pSource, NULL);
-        glCompileShader(shader);
-        GLint compiled = 0;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (!compiled) {
-            GLint infoLen = 0;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-            if (infoLen) {
-                char *buf = (char *) malloc(infoLen);
-                if (buf) {
-                    glGetShaderInfoLog(shader, infoLen, NULL, buf);
-                    LOGE("Could not compile shader %d:\n%s\n",
-                         shaderType, buf);
-                    free(buf);
-                }
-                glDeleteShader(shader);
-                shader = 0;
-            }
-        }
-    }
+// NV12 tiles: Y and interleaved UV come in as separate textures (UV as
+// luminance/alpha) and are converted to RGB here.
+static auto gNv12FragmentShader =
+        "precision mediump float;\n"
+            "uniform sampler2D yTexture;\n"
+            "uniform sampler2D uvTexture;\n"
+            "uniform mat3 yuvMatrix;\n"
+            "uniform vec3 yuvOffset;\n"
+            "varying vec2 vTexCoord;\n"
+            "void main() {\n"
+            "   vec3 yuv = vec3(texture2D(yTexture, vTexCoord).r, texture2D(uvTexture, vTexCoord).ra);\n"
+            "   gl_FragColor = vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+            "}";
 
-    return shader;
-}
+// MIPI10 Bayer tiles: the packed bytes come in untouched as a luminance texture
+// of width * 5 / 4 texels per row. Each output pixel is one BGGR quad: its four
+// 10-bit samples are unpacked here and give B, the mean of the greens, and R.
+// Within a 5-byte group, sample k has its 2 low bits at bits 7-2k..6-2k of the
+// fifth byte. Byte addresses exceed mediump range on wide sensors.
+static auto gMipi10FragmentShader =
+        "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+            "precision highp float;\n"
+            "#else\n"
+            "precision mediump float;\n"
+            "#endif\n"
+            "uniform sampler2D rawTexture;\n"
+            "uniform vec2 rawSize;\n"
+            "uniform vec2 quadCount;\n"
+            "varying vec2 vTexCoord;\n"
+            "float fetch(float x, float y) {\n"
+            "   return floor(texture2D(rawTexture, (vec2(x, y) + 0.5) / rawSize).r * 255.0 + 0.5);\n"
+            "}\n"
+            "float unpack(float msbs, float lsbs, float k) {\n"
+            "   return (msbs * 4.0 + mod(floor(lsbs / exp2(6.0 - 2.0 * k)), 4.0)) / 1023.0;\n"
+            "}\n"
+            "void main() {\n"
+            "   vec2 quad = min(floor(vTexCoord * quadCount), quadCount - 1.0);\n"
+            "   float group = floor(quad.x / 2.0);\n"
+            "   float k = 2.0 * (quad.x - 2.0 * group);\n"
+            "   float x = 5.0 * group + k;\n"
+            "   float lsbX = 5.0 * group + 4.0;\n"
+            "   float y0 = 2.0 * quad.y;\n"
+            "   float y1 = y0 + 1.0;\n"
+            "   float lsbs0 = fetch(lsbX, y0);\n"
+            "   float lsbs1 = fetch(lsbX, y1);\n"
+            "   float b = unpack(fetch(x, y0), lsbs0, k);\n"
+            "   float g0 = unpack(fetch(x + 1.0, y0), lsbs0, k + 1.0);\n"
+            "   float g1 = unpack(fetch(x, y1), lsbs1, k);\n"
+            "   float r = unpack(fetch(x + 1.0, y1), lsbs1, k + 1.0);\n"
+            "   gl_FragColor = vec4(r, 0.5 * (g0 + g1), b, 1.0);\n"
+            "}";
 
-GLuint createProgram(const char *pVertexSource, const char *pFragmentSource) {
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, pVertexSource);
-    if (!vertexShader) {
-        return 0;
-    }
+// 10-bit YUV tiles (P010, TP10) need OpenGL ES 3: both planes come in as
+// unsigned integer textures, 16-bit samples for P010 and 32-bit words of three
+// samples for TP10, and are unpacked here without ever being filtered. The UV
+// plane texture is addressed by sample, so U and V of a pixel pair are adjacent.
+static auto gEs3VertexShader =
+        "#version 300 es\n"
+            "in vec2 aPosition;\n"
+            "in vec2 aTexCoord;\n"
+            "out vec2 vTexCoord;\n"
+            "void main() {\n"
+            "   gl_Position = vec4(aPosition, 0.0, 1.0);\n"
+            "   vTexCoord = aTexCoord;\n"
+            "}";
 
-    GLuint pixelShader = loadShader(GL_FRAGMENT_SHADER, pFragmentSource);
-    if (!pixelShader) {
-        return 0;
+// Instanced tiles: a unit quad is stretched over each instance's rectangle and
+// samples the instance's layer of a texture array.
+static auto gInstancedVertexShader =
+        "#version 300 es\n"
+            "in vec2 aCorner;\n"
+            "in vec4 aRect;\n"
+            "in vec4 aUvRect;\n"
+            "in float aLayer;\n"
+            "out vec2 vTexCoord;\n"
+            "flat out float vLayer;\n"
+            "void main() {\n"
+            "   gl_Position = vec4(mix(aRect.xy, aRect.zw, aCorner), 0.0, 1.0);\n"
+            "   vTexCoord = mix(aUvRect.xy, aUvRect.zw, aCorner);\n"
+            "   vLayer = aLayer;\n"
+            "}";
+
+static auto gInstancedFragmentShader =
+        "#version 300 es\n"
+            "precision mediump float;\n"
+            "precision mediump sampler2DArray;\n"
+            "uniform sampler2DArray tileArray;\n"
+            "in vec2 vTexCoord;\n"
+            "flat in float vLayer;\n"
+            "out vec4 fragColor;\n"
+            "void main() {\n"
+            "   fragColor = texture(tileArray, vec3(vTexCoord, vLayer));\n"
+            "}";
+
+static auto gYuv10FragmentShader =
+        "#version 300 es\n"
+            "precision highp float;\n"
+            "precision highp int;\n"
+            "precision highp usampler2D;\n"
+            "uniform usampler2D yTexture;\n"
+            "uniform usampler2D uvTexture;\n"
+            "uniform bool tp10;\n"
+            "uniform ivec2 lumaSize;\n"
+            "uniform mat3 yuvMatrix;\n"
+            "uniform vec3 yuvOffset;\n"
+            "in vec2 vTexCoord;\n"
+            "out vec4 fragColor;\n"
+            "float sample10(usampler2D plane, int x, int y) {\n"
+            "   if (tp10)\n"
+            "       return float((texelFetch(plane, ivec2(x / 3, y), 0).r >> uint(10 * (x % 3))) & 1023u);\n"
+            "   return float(texelFetch(plane, ivec2(x, y), 0).r >> 6u);\n"
+            "}\n"
+            "void main() {\n"
+            "   ivec2 p = min(ivec2(vTexCoord * vec2(lumaSize)), lumaSize - 1);\n"
+            "   int cx = p.x / 2 * 2;\n"
+            "   vec3 yuv = vec3(sample10(yTexture, p.x, p.y),\n"
+            "                   sample10(uvTexture, cx, p.y / 2),\n"
+            "                   sample10(uvTexture, cx + 1, p.y / 2)) / 1023.0;\n"
+            "   fragColor = vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+            "}";
+
+// Limited-range YUV to RGB, column-major as glUniformMatrix3fv wants it:
+// one column each for the Y, U and V contributions to (R, G, B).
+const GLfloat gBt601Matrix[] = {
+        1.164f, 1.164f, 1.164f,
+        0.0f, -0.392f, 2.017f,
+        1.596f, -0.813f, 0.0f
+};
+const GLfloat gBt709Matrix[] = {
+        1.164f, 1.164f, 1.164f,
+        0.0f, -0.213f, 2.112f,
+        1.793f, -0.533f, 0.0f
+};
+const GLfloat gBt2020Matrix[] = {
+        1.164f, 1.164f, 1.164f,
+        0.0f, -0.187f, 2.142f,
+        1.679f, -0.650f, 0.0f
+};
+const GLfloat gYuvOffset[] = { 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f };
+const GLfloat gYuv10Offset[] = { 64.0f / 1023.0f, 512.0f / 1023.0f, 512.0f / 1023.0f };
+
+static const GLfloat *yuvMatrixFor(yuv_matrix_t matrix) {
+    switch (matrix) {
+        case YUV_MATRIX_BT709:
+            return gBt709Matrix;
+        case YUV_MATRIX_BT2020:
+            return gBt2020Matrix;
+        default:
+            return gBt601Matrix;
     }
+}
 
-    GLuint program = glCreateProgram();
-    if (program) {
-        glAttachShader(program, vertexShader);
-        checkGlError("glAttachShader");
-        glAttachShader(program, pixelShader);
-        checkGlError("glAttachShader");
-        glLinkProgram(program);
-        GLint linkStatus = GL_FALSE;
-        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus != GL_TRUE) {
-            GLint bufLength = 0;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufLength);
-            if (bufLength) {
-                char *buf = (char *) malloc(bufLength);
-                if (buf) {
-                    glGetProgramInfoLog(program, bufLength, NULL, buf);
-                    LOGE("Could not link program:\n%s\n", buf);
-                    free(buf);
-                }
-            }
-            glDeleteProgram(program);
-            program = 0;
-        }
+// Built-in program that draws tiles of one non-RGB input format.
+struct tile_program_t {
+    GLuint id;
+    GLint aPosition;
+    GLint aTexCoord;
+    GLint yTexture;
+    GLint uvTexture;
+    GLint yuvMatrix;
+    GLint yuvOffset;
+    GLint rawTexture;
+    GLint rawSize;
+    GLint quadCount;
+    GLint tp10;
+    GLint lumaSize;
+    GLint aCorner;
+    GLint aRect;
+    GLint aUvRect;
+    GLint aLayer;
+    GLint tileArray;
+};
+
+// A texture whose storage is allocated once and then overwritten in place
+// every frame; it is only reallocated when the size or format changes.
+struct stream_texture_t {
+    GLuint id;
+    GLint internalFormat;
+    GLsizei width;
+    GLsizei height;
+    uint64_t reallocations;
+    stage_timer upload;
+};
+
+// One independent input: its reader, the thread reading it ahead and the
+// texture holding its latest frame.
+struct stream_t {
+    std::string name;
+    std::unique_ptr<mapped_frame_source> source;
+    ingest_thread ingest;
+    // Frames as they are uploaded: the source's, downscaled on ingest to the
+    // size the stream's tiles show it at.
+    frame_format_t format;
+    // RGB, or the Y plane of a YUV stream.
+    stream_texture_t texture;
+    // UV plane of a YUV stream.
+    stream_texture_t uv_texture;
+    yuv_matrix_t yuv_matrix;
+    // With UPLOAD_PBO: the buffers backing the ingest ring, and the slots whose
+    // buffers the GPU is still copying from, oldest first.
+    unpack_buffer_ring pbos;
+    std::vector<frame_slot_t *> in_flight;
+    // In atlas mode: index into mAtlasPages and the stream's corner on that
+    // page, or -1 if the stream has its own texture.
+    int atlas_page;
+    uint32_t atlas_x;
+    uint32_t atlas_y;
+    // In instanced mode: index into mTextureArrays and the stream's layer, or
+    // -1 if the stream has its own texture.
+    int array_index;
+    GLint array_layer;
+    // A new frame was uploaded this tick, so the stream's tiles are dirty.
+    bool updated;
+};
+
+// Frames the ingest thread may read ahead of the GL thread.
+const size_t INGEST_RING_SLOTS = 4;
+// Halvings at most applied on ingest, i.e. down to an 8th of the width.
+const unsigned MAX_DOWNSCALE_LEVELS = 3;
+
+// Atlas mode: textures shared by several streams of one upload format, each
+// with the vertex indices of every tile showing one of them.
+struct atlas_texture_t {
+    GLuint id;
+    GLint format;
+    atlas_size_t size;
+    std::vector<GLushort> indices;
+};
+// Free texels between atlas neighbours. Each stream's edge texels are
+// replicated into the one next to its rectangle, so linear filtering at a
+// tile's edge reads what CLAMP_TO_EDGE gives a texture of its own.
+const uint32_t ATLAS_PADDING = 2;
+const GLint ATLAS_MAX_SIZE = 4096;
+
+// Instanced mode: streams of one upload format and size share a texture
+// array, one layer each, and every tile showing one of them is an instance
+// of one quad. Per instance, mInstanceBuffer holds the tile's clip space
+// rectangle, its texture coordinates at two opposite corners and its layer.
+struct texture_array_t {
+    GLuint id;
+    GLint format;
+    GLsizei width;
+    GLsizei height;
+    GLsizei layers;
+    GLint firstInstance;
+    GLsizei instances;
+};
+const int INSTANCE_FLOATS = 9;
+
+// Dirty tiles: only the tiles whose stream produced a frame are redrawn, under
+// a scissor, when the target keeps its contents between ticks. That is the
+// composite render target, or a window surface with preserved swaps.
+// mRedrawAll is set whenever the layout or the target changes.
+struct dirty_rect_t {
+    GLint x0;
+    GLint y0;
+    GLint x1;
+    GLint y1;
+};
+// Beyond this many dirty tiles one scissor box around all of them is cheaper.
+const size_t MAX_SCISSOR_RECTS = 4;
+
+// Read backs are written out on mEncoder's thread while the next frames are
+// drawn; this many may wait for it before the GL thread does.
+const size_t ENCODE_QUEUE_DEPTH = 3;
+// Read back buffers the frame callback and pull_frame() consumers may hold on
+// to at once, on top of those queued for the encoder and for pulling.
+const size_t HELD_READBACKS = 2;
+
+// READBACK_PBO: frames whose glReadPixels may be in flight at once. Each is
+// mapped once its fence signals, usually a tick or two later; when all are in
+// flight the oldest is waited for.
+const size_t PACK_BUFFER_COUNT = 3;
+// The frame last read back at one depth. A read of only the rows that changed
+// takes the others from it, so it stays referenced until the next one is filled.
+struct readback_rows_t {
+    readback_buffer last;
+    size_t bytes;
+};
+// A read back in flight in the pack buffer of the same index. Once it lands,
+// rows y0 to y1 are copied into buffer, the others from previous, the frame
+// read back before it at that depth, and buffer is handed to the encode thread.
+// The pack buffer holds its rows readRowBytes apart.
+struct pending_readback_t {
+    uint64_t frameId;
+    compositor_pixels_t pixels;
+    readback_buffer buffer;
+    readback_buffer previous;
+    size_t rowBytes;
+    size_t readRowBytes;
+    int rows;
+    int y0;
+    int y1;
+};
+
+// Everything a compositor owns, on the GL context it was created with.
+class compositor::impl {
+public:
+    GLint outputWidth();
+    GLint outputHeight();
+    bool initTilePrograms();
+    bool initProgram();
+    bool setupGraphics(int w, int h);
+    void uploadTileGeometry();
+    void buildTileGeometry();
+    void releaseSharedTextures();
+    void closeStreams();
+    void contextLost();
+    void buildAtlas();
+    void buildTextureArrays();
+    unsigned downscaleLevelsFor(size_t streamIndex);
+    void startIngest();
+    bool openStreams(const stream_manifest_t &manifest);
+    void uploadStreamFrame(stream_t &stream, const unsigned char *data);
+    void uploadAtlasBorder(const stream_t &stream, const atlas_texture_t &page, const unsigned char *data);
+    void setTileAttributes(GLint position, GLint texCoord);
+    void drawInstancedTiles();
+    void drawNv12Tiles();
+    void drawMipi10Tiles();
+    void drawYuv10Tiles();
+    dirty_rect_t tilePixels(size_t t);
+    void collectDirtyRects(std::vector<dirty_rect_t> &rects);
+    void drawTiles();
+    bool bindComposite();
+    void drawTextureQuad(GLuint texture, GLint width, GLint height, bool flipY);
+    void presentComposite();
+    bool writeOutputFrame(const unsigned char *data, size_t rowBytes, int rows, bool topDown);
+    void encodeFrame(const encode_frame_t &frame);
+    readback_buffer acquireReadback(size_t bytes);
+    void submitReadback(const readback_buffer &buffer, size_t rowBytes, int rows, compositor_pixels_t pixels,
+                        uint64_t frameId);
+    bool completeOldestReadback(bool wait);
+    void collectReadbacks();
+    void drainReadbacks();
+    void keepForPull(const compositor_frame_t &frame);
+    void setPullQueue(size_t depth);
+    void applyPullQueue();
+    bool pullFrame(compositor_frame_t &frame);
+    // Read is called as bool(unsigned char *); a template rather than a
+    // std::function, which would allocate for the capturing lambdas every tick.
+    template <typename Read>
+    bool readRows(readback_rows_t &frame, size_t rowBytes, int rows, int y0, int y1,
+                  compositor_pixels_t pixels, uint64_t frameId, const Read &read, size_t readRowBytes = 0);
+    void flush();
+    void setFrameCallback(const compositor_frame_callback_t &callback);
+    bool deepReadback() const;
+    bool readBackDeep(int bw, int bh, int y0, int y1, uint64_t frameId);
+    GLuint copyToCompositeTexture(GLenum internalFormat, int bw, int bh);
+    bool readBackLuma(int bw, int bh, uint64_t frameId);
+    bool readBackNv12(int bw, int bh, bool offscreen, uint64_t frameId);
+    void readBackFrame(int bw, int bh, int readY0, int readY1, bool offscreen);
+    bool renderFrame();
+    void initContext();
+    bool init(const std::string &manifest_path);
+    bool initDefault();
+    bool loadShaderSources(const char *vertex_source, const char *fragment_source);
+    void freeShaderSources();
+    bool finished() const;
+    bool setOutput(const std::string &path);
+    ~impl();
+
+    GLuint programId = 0;
+    GLuint aPosition = 0;
+    GLuint aTexCoord = 0;
+    GLuint rubyTexture = 0;
+    //GLuint lut;
+    GLuint rubyTextureSize = 0;
+    GLuint rubyInputSize = 0;
+    GLuint rubyOutputSize = 0;
+
+    //GLuint lut_map;
+
+    tile_program_t mNv12Program = tile_program_t();
+    tile_program_t mMipi10Program = tile_program_t();
+    tile_program_t mYuv10Program = tile_program_t();
+    tile_program_t mInstancedProgram = tile_program_t();
+
+    // OpenGL ES 3 is optional: without it 10-bit streams stay black and the
+    // composite is read back as RGBA8.
+    bool mGles3 = false;
+
+    int scnw = 0, scnh = 0, vw = 0, vh = 0;
+    char *mVs = NULL, *mFs = NULL;
+
+    // Size the tiles are composited and read back at; zero follows the window.
+    GLint mOutputWidth = 0, mOutputHeight = 0;
+    // Whether an offscreen composite is shown in the window at all.
+    bool mPreview = true;
+    // Tiles are composited upside down offscreen, so the composite reads back
+    // top row first and the preview is flipped on the way to the window.
+    bool mTopDown = false;
+
+    std::vector<std::unique_ptr<stream_t> > mStreams;
+    // Index into mStreams of the stream each tile shows, in layout order.
+    std::vector<size_t> mTileStreams;
+    // Six vertices per tile, drawn one tile at a time. The positions of all tiles
+    // followed by their texture coordinates are kept in a static buffer object,
+    // which is only rewritten when the layout changes.
+    tile_layout_t mLayout = make_grid_layout();
+    // The rectangles the layout placed the tiles in, before any top-down flip.
+    std::vector<tile_rect_t> mTileRects;
+    std::vector<GLfloat> mTileVertices;
+    std::vector<GLfloat> mTileTexCoords;
+    GLuint mTileBuffer = 0;
+    // Containers play at their recorded rate unless a batch driver wants them read flat out.
+    bool mPaced = true;
+    compositor_stages_t mStages;
+    upload_mode_t mUploadMode = UPLOAD_DIRECT;
+    bool mAtlasMode = false;
+    std::vector<atlas_texture_t> mAtlasPages;
+    // A column of atlas border texels, gathered where there is no
+    // GL_UNPACK_ROW_LENGTH.
+    std::vector<unsigned char> mAtlasColumn;
+    std::vector<texture_array_t> mTextureArrays;
+    bool mInstancedMode = false;
+    GLuint mQuadBuffer = 0;
+    GLuint mInstanceBuffer = 0;
+
+    bool mPreservedSurface = false;
+    bool mRedrawAll = true;
+    // Reused every tick, so the steady state doesn't allocate.
+    std::vector<dirty_rect_t> mDirtyRects;
+    readback_rows_t mReadPixels = readback_rows_t();
+    // With an output file every composited frame is appended to it raw, instead
+    // of being dumped as images for inspection on the device.
+    std::ofstream mOutput;
+    encode_thread mEncoder;
+    compositor_frame_callback_t mFrameCallback;
+    // Every frame is read back straight into a buffer of this pool, which
+    // travels on to the encoder, the callback and the pull queue by reference.
+    readback_pool mReadbackPool;
+    size_t mReadbackBuffers = 0;
+    // The last mPullDepth frames, oldest at mPulledHead, for pull_frame() on
+    // any thread; guarded by mPullMutex.
+    size_t mPullDepth = 0;
+    std::mutex mPullMutex;
+    // A depth asked for on any thread, taken up by the next renderFrame();
+    // guarded by mPullMutex.
+    size_t mRequestedPullDepth = 0;
+    bool mPullDepthRequested = false;
+    std::vector<compositor_frame_t> mPulled;
+    size_t mPulledHead = 0;
+    size_t mPulledCount = 0;
+    readback_mode_t mReadbackMode = READBACK_SYNC;
+    pack_buffer_ring mPackBuffers;
+    // One per pack buffer; the mPendingCount before mNextPackBuffer are in flight.
+    std::vector<pending_readback_t> mPendingReadbacks;
+    size_t mPendingCount = 0;
+    size_t mNextPackBuffer = 0;
+    // Frames read back so far.
+    uint64_t mReadBackCount = 0;
+
+    // Set when every stream is luminance only; the composite is then read back as
+    // one byte per pixel through mPackPass instead of as RGBA.
+    bool mMonoOutput = false;
+    pack_pass mPackPass;
+    GLuint mCompositeTexture = 0;
+    readback_rows_t mMonoReadback = readback_rows_t();
+    readback_rows_t mNv12Readback = readback_rows_t();
+
+    // Deep read back formats composite offscreen in half float (or straight into
+    // RGB10_A2 where half float isn't renderable), and a configured output size in
+    // RGBA8; either is then scaled into the window as a preview.
+    readback_format_t mReadback = READBACK_RGBA8;
+    render_target mComposite;
+    render_target mReadback10;
+    readback_rows_t mDeepReadback = readback_rows_t();
+
+    // Time spent in each read back path, logged every 60 read backs.
+    stage_timer mDeepRead;
+    stage_timer mLumaRead;
+    stage_timer mNv12Read;
+    stage_timer mRgbaRead;
+};
+
+static bool buildTileProgram(tile_program_t &program, const char *vertexSource, const char *fragmentSource) {
+    program.id = build_program(vertexSource, fragmentSource);
+    if (!program.id) {
+        LOGE("Could not create tile program.");
+        return false;
     }
-    return program;
-}
-
-GLuint programId;
-GLuint aPosition;
-GLuint aTexCoord;
-GLuint rubyTexture1;
-GLuint rubyTexture2;
-GLuint rubyTexture3;
-GLuint rubyTexture4;
-//GLuint lut;
-GLuint rubyTextureSize;
-GLuint rubyInputSize;
-GLuint rubyOutputSize;
-
-GLuint texture_map1;
-//GLuint lut_map;
-GLuint texture_map2;
-GLuint texture_map3;
-GLuint texture_map4;
-
-GLuint iFrameBuffObject;
-
-int scnw, scnh, vw, vh;
-char *gVs, *gFs;
-unsigned char * rawData = NULL;
-FILE *fp = NULL;
-int freadbw, freadbh;
-int fread_buf_size;
-bool initProgram() {
-//    LOGI("initProgram vs=%s fs=%s", gVs, gFs);
-    if(!gVs)
-        gVs = (char *)gVertexShader;
-    if(!gFs)
-        gFs = (char *)gFragmentShader;
-    programId = createProgram(gVs, gFs);
+    program.aPosition = glGetAttribLocation(program.id, "aPosition");
+    program.aTexCoord = glGetAttribLocation(program.id, "aTexCoord");
+    program.yTexture = glGetUniformLocation(program.id, "yTexture");
+    program.uvTexture = glGetUniformLocation(program.id, "uvTexture");
+    program.yuvMatrix = glGetUniformLocation(program.id, "yuvMatrix");
+    program.yuvOffset = glGetUniformLocation(program.id, "yuvOffset");
+    program.rawTexture = glGetUniformLocation(program.id, "rawTexture");
+    program.rawSize = glGetUniformLocation(program.id, "rawSize");
+    program.quadCount = glGetUniformLocation(program.id, "quadCount");
+    program.tp10 = glGetUniformLocation(program.id, "tp10");
+    program.lumaSize = glGetUniformLocation(program.id, "lumaSize");
+    program.aCorner = glGetAttribLocation(program.id, "aCorner");
+    program.aRect = glGetAttribLocation(program.id, "aRect");
+    program.aUvRect = glGetAttribLocation(program.id, "aUvRect");
+    program.aLayer = glGetAttribLocation(program.id, "aLayer");
+    program.tileArray = glGetUniformLocation(program.id, "tileArray");
+    return true;
+}
+
+GLint compositor::impl::outputWidth() {
+    return mOutputWidth ? mOutputWidth : scnw;
+}
+
+GLint compositor::impl::outputHeight() {
+    return mOutputHeight ? mOutputHeight : scnh;
+}
+
+bool compositor::impl::initTilePrograms() {
+    if (mNv12Program.id)
+        glDeleteProgram(mNv12Program.id);
+    if (mMipi10Program.id)
+        glDeleteProgram(mMipi10Program.id);
+    if (mYuv10Program.id)
+        glDeleteProgram(mYuv10Program.id);
+    if (mInstancedProgram.id)
+        glDeleteProgram(mInstancedProgram.id);
+    mYuv10Program.id = 0;
+    mInstancedProgram.id = 0;
+    if (!buildTileProgram(mNv12Program, gVertexShader, gNv12FragmentShader) ||
+        !buildTileProgram(mMipi10Program, gVertexShader, gMipi10FragmentShader))
+        return false;
+    return !mGles3 || (buildTileProgram(mYuv10Program, gEs3VertexShader, gYuv10FragmentShader) &&
+                       buildTileProgram(mInstancedProgram, gInstancedVertexShader, gInstancedFragmentShader));
+}
+
+// Formats the default program can sample directly.
+static bool drawnByRgbProgram(pixel_format_t format) {
+    return format == PIXEL_FORMAT_RGB24 || format == PIXEL_FORMAT_Y8;
+}
+
+// Formats whose textures hold packed or integer samples that must be fetched
+// exactly, never blended with their neighbours.
+static bool needsExactFetch(pixel_format_t format) {
+    return format == PIXEL_FORMAT_MIPI10 || format == PIXEL_FORMAT_P010 || format == PIXEL_FORMAT_TP10;
+}
+
+static bool isYuv10(pixel_format_t format) {
+    return format == PIXEL_FORMAT_P010 || format == PIXEL_FORMAT_TP10;
+}
+
+bool compositor::impl::initProgram() {
+//    LOGI("initProgram vs=%s fs=%s", mVs, mFs);
+    if(!mVs)
+        mVs = (char *)gVertexShader;
+    if(!mFs)
+        mFs = (char *)gFragmentShader;
+    programId = build_program(mVs, mFs);
     if (!programId) {
         LOGE("Could not create program.");
         return false;
@@ -183,368 +642,1649 @@ bool initProgram() {
 
     aPosition = glGetAttribLocation(programId, "aPosition");
     aTexCoord = glGetAttribLocation(programId, "aTexCoord");
-    rubyTexture1 = glGetUniformLocation(programId, "rubyTexture1");
-    rubyTexture2 = glGetUniformLocation(programId, "rubyTexture2");
-
-    rubyTexture3 = glGetUniformLocation(programId, "rubyTexture3");
-    rubyTexture4 = glGetUniformLocation(programId, "rubyTexture4");
+    rubyTexture = glGetUniformLocation(programId, "rubyTexture");
 
     rubyTextureSize = glGetUniformLocation(programId, "rubyTextureSize");
     rubyInputSize = glGetUniformLocation(programId, "rubyInputSize");
     rubyOutputSize = glGetUniformLocation(programId, "rubyOutputSize");
 
-    return true;
+    return initTilePrograms() && mPackPass.init();
 }
 
-bool setupGraphics(int w, int h) {
+
+bool compositor::impl::setupGraphics(int w, int h) {
+    const bool resized = w != scnw || h != scnh;
     scnw = w;
     scnh = h;
     LOGI("setupGraphics(%d, %d)", w, h);
     glViewport(0, 0, scnw, scnh);
+    // Only worth asking for when the config supports it; the surface is recreated with the context.
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLSurface surface = eglGetCurrentSurface(EGL_DRAW);
+    mPreservedSurface = surface != EGL_NO_SURFACE &&
+                        eglSurfaceAttrib(display, surface, EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED);
+    LOGI("window surface %s its contents between frames", mPreservedSurface ? "keeps" : "doesn't keep");
+    mRedrawAll = true;
+    // Tiles changed size, so streams are downscaled differently on ingest.
+    // A configured output size doesn't follow the window.
+    if (resized && !mStreams.empty() && !mOutputWidth) {
+        buildTileGeometry();
+        startIngest();
+    }
     return true;
 }
-/* for two its working
-const GLfloat gTriangleVertices[] = {
-        -1.0f, -1.0f,
-        0.0f, -1.0f,
-        -1.0f, 1.0f,
 
-        -1.0f, 1.0f,
-        0.0f,-1.0f,
-        0.0f,1.0f,
+void compositor::impl::uploadTileGeometry() {
+    if (mTileVertices.empty())
+        return;
+    if (!mTileBuffer)
+        glGenBuffers(1, &mTileBuffer);
+    const GLsizeiptr bytes = mTileVertices.size() * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, mTileBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 2 * bytes, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, mTileVertices.data());
+    glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, mTileTexCoords.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-        -0.0f, -1.0f,
-        1.0f, -1.0f,
-        -0.0f, 1.0f,
+// Places the tiles as mLayout says for the current output size.
+void compositor::impl::buildTileGeometry() {
+    std::vector<float> aspects(mTileStreams.size());
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const frame_format_t &format = mStreams[mTileStreams[t]]->source->format();
+        aspects[t] = format.height ? (float) format.width / format.height : 0.0f;
+    }
+    std::vector<tile_rect_t> &rects = mTileRects;
+    layout_tiles(mLayout, aspects, outputWidth(), outputHeight(), rects);
+    mRedrawAll = true;
+    mTileVertices.resize(rects.size() * 12);
+    mTileTexCoords.resize(rects.size() * 12);
+    for (size_t t = 0; t < rects.size(); t++) {
+        tile_vertices(rects[t], &mTileVertices[t * 12], &mTileTexCoords[t * 12]);
+    }
+    if (mTopDown) {
+        for (size_t i = 1; i < mTileVertices.size(); i += 2)
+            mTileVertices[i] = -mTileVertices[i];
+    }
+    uploadTileGeometry();
+}
 
-        -0.0f, 1.0f,
-        1.0f,-1.0f,
-        1.0f,1.0f
+static GLuint createStreamTexture(GLint filter) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
 
-};
+// Deletes atlas pages and texture arrays; streams go back to their own textures.
+void compositor::impl::releaseSharedTextures() {
+    for (size_t p = 0; p < mAtlasPages.size(); p++) {
+        glDeleteTextures(1, &mAtlasPages[p].id);
+    }
+    mAtlasPages.clear();
+    for (size_t a = 0; a < mTextureArrays.size(); a++) {
+        glDeleteTextures(1, &mTextureArrays[a].id);
+    }
+    mTextureArrays.clear();
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        mStreams[s]->atlas_page = -1;
+        mStreams[s]->array_index = -1;
+    }
+}
 
-const GLfloat gTexVertices[] = {
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
+// Stops the ingest thread and drops the frames and buffers it filled.
+static void stopIngest(stream_t &stream) {
+    stream.ingest.stop();
+    stream.in_flight.clear();
+    stream.pbos.release();
+}
 
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f,
+void compositor::impl::closeStreams() {
+    releaseSharedTextures();
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        stopIngest(*mStreams[s]);
+        glDeleteTextures(1, &mStreams[s]->texture.id);
+        glDeleteTextures(1, &mStreams[s]->uv_texture.id);
+    }
+    mStreams.clear();
+    mTileStreams.clear();
+    buildTileGeometry();
+}
 
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
+// The context every GL name here belongs to is gone, e.g. a GLSurfaceView
+// paused and resumed. The names are forgotten without deleting anything: in
+// the next context they may already name its new objects.
+void compositor::impl::contextLost() {
+    // Frames read into the lost pack buffers never land.
+    mPendingReadbacks.clear();
+    mPendingCount = 0;
+    mNextPackBuffer = 0;
+    mPackBuffers.abandon();
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        mStreams[s]->ingest.stop();
+        mStreams[s]->in_flight.clear();
+        mStreams[s]->pbos.abandon();
+    }
+    mStreams.clear();
+    mTileStreams.clear();
+    mAtlasPages.clear();
+    mTextureArrays.clear();
+    mTileBuffer = 0;
+    mQuadBuffer = 0;
+    mInstanceBuffer = 0;
+    programId = 0;
+    mNv12Program = tile_program_t();
+    mMipi10Program = tile_program_t();
+    mYuv10Program = tile_program_t();
+    mInstancedProgram = tile_program_t();
+    mPackPass.abandon();
+    mCompositeTexture = 0;
+    mComposite.abandon();
+    mReadback10.abandon();
+    mRedrawAll = true;
+}
 
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f
-};
-*/
-
-const GLfloat gTriangleVertices[] = {
-        -1.0f, 0.0f,
-        0.0f, -0.0f,
-        -1.0f, 1.0f,
-
-        -1.0f, 1.0f,
-        0.0f,-0.0f,
-        0.0f,1.0f,
-//1st img end
-        -0.0f, -0.0f,
-        1.0f, -0.0f,
-        -0.0f, 1.0f,
-
-        -0.0f, 1.0f,
-        1.0f,-0.0f,
-        1.0f,1.0f,
-//2nd img end
-        -1.0f, -1.0f,
-        0.0f, -1.0f,
-        -1.0f, 0.0f,
-
-        -1.0f, 0.0f,
-        0.0f,-1.0f,
-        0.0f,0.0f,
-//3rd image end
-        -0.0f, -1.0f,
-        1.0f, -1.0f,
-        -0.0f, 0.0f,
-
-        -0.0f, 0.0f,
-        1.0f,-1.0f,
-        1.0f,0.0f
-//4th image end
-};
+// Upload format of streams that can share an atlas page, or 0.
+static GLint atlasFormatFor(pixel_format_t format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGB24:
+            return GL_RGBA;
+        case PIXEL_FORMAT_Y8:
+            return GL_LUMINANCE;
+        default:
+            return 0;
+    }
+}
 
-const GLfloat gTexVertices[] = {
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f,
-//1st img end
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f,
-//2nd img end
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f,
-//3rd img end
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        1.0f,1.0f,
-        1.0f,0.0f
-        //4th img end
-};
-std::chrono::high_resolution_clock::time_point glReadStartTime;
-std::chrono::high_resolution_clock::time_point glReadEndTime;
-std::chrono::high_resolution_clock::time_point FlipStartTime;
-std::chrono::high_resolution_clock::time_point FlipEndTime;
-void renderFrame() // 16.6ms
-{
-    float grey;
-    grey = 0.00f;
+// Packs the streams of each atlas format onto shared pages and points their
+// tiles' texture coordinates at their sub-rectangles.
+void compositor::impl::buildAtlas() {
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    maxSize = std::min(maxSize, ATLAS_MAX_SIZE);
+    if (mTileStreams.size() * 6 > 65535) {
+        LOGE("too many tiles for an atlas");
+        return;
+    }
 
-    glClearColor(grey, grey, grey, 1.0f);
-    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-    if(fp!=NULL) {
-        if (!feof(fp)) {
-            fread(rawData, fread_buf_size, 1, fp);
-        }else{ DPRINTF("feof end of stream");}
+    const GLint formats[] = { GL_RGBA, GL_LUMINANCE };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        std::vector<size_t> members;
+        std::vector<atlas_size_t> sizes;
+        for (size_t s = 0; s < mStreams.size(); s++) {
+            const frame_format_t &format = mStreams[s]->format;
+            if (atlasFormatFor(format.pixel_format) != formats[f] || format.width == 0 ||
+                mStreams[s]->array_index >= 0)
+                continue;
+            atlas_size_t size = { format.width, format.height };
+            members.push_back(s);
+            sizes.push_back(size);
+        }
+        std::vector<atlas_rect_t> rects;
+        std::vector<atlas_size_t> pages;
+        if (members.size() < 2)
+            continue;
+        if (!pack_atlas(sizes, maxSize, ATLAS_PADDING, rects, pages)) {
+            LOGE("a stream is larger than an atlas page, keeping separate textures");
+            continue;
+        }
+
+        const size_t firstPage = mAtlasPages.size();
+        for (size_t p = 0; p < pages.size(); p++) {
+            atlas_texture_t page;
+            page.id = createStreamTexture(GL_LINEAR);
+            page.format = formats[f];
+            page.size = pages[p];
+            glTexImage2D(GL_TEXTURE_2D, 0, page.format, page.size.width, page.size.height, 0, page.format,
+                         GL_UNSIGNED_BYTE, NULL);
+            mAtlasPages.push_back(page);
+        }
+        for (size_t m = 0; m < members.size(); m++) {
+            stream_t &stream = *mStreams[members[m]];
+            stream.atlas_page = (int) (firstPage + rects[m].page);
+            stream.atlas_x = rects[m].x;
+            stream.atlas_y = rects[m].y;
+        }
+        LOGI("atlas: %zu streams on %zu pages", members.size(), pages.size());
     }
-    else {
-        DPRINTF("fp is null");
+
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const stream_t &stream = *mStreams[mTileStreams[t]];
+        if (stream.atlas_page < 0)
+            continue;
+        atlas_texture_t &page = mAtlasPages[stream.atlas_page];
+        const frame_format_t &format = stream.format;
+        GLfloat *texCoords = &mTileTexCoords[t * 12];
+        for (int v = 0; v < 6; v++) {
+            texCoords[2 * v] = (stream.atlas_x + texCoords[2 * v] * format.width) / page.size.width;
+            texCoords[2 * v + 1] = (stream.atlas_y + texCoords[2 * v + 1] * format.height) / page.size.height;
+            page.indices.push_back((GLushort) (t * 6 + v));
+        }
     }
+    uploadTileGeometry();
+}
 
+// Gives every RGB24 or Y8 stream a layer in a texture array shared with the
+// streams of the same upload format and size, and lists the tiles showing
+// them as instances, grouped by array.
+void compositor::impl::buildTextureArrays() {
+    if (!mGles3) {
+        LOGE("instanced tiles need OpenGL ES 3");
+        return;
+    }
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        stream_t &stream = *mStreams[s];
+        const GLint format = atlasFormatFor(stream.format.pixel_format);
+        if (!format || stream.format.width == 0 || stream.source->frame_count() == 0)
+            continue;
+        size_t a = 0;
+        while (a < mTextureArrays.size() &&
+               (mTextureArrays[a].format != format || mTextureArrays[a].width != (GLsizei) stream.format.width ||
+                mTextureArrays[a].height != (GLsizei) stream.format.height || mTextureArrays[a].layers == maxLayers))
+            a++;
+        if (a == mTextureArrays.size()) {
+            texture_array_t array = { 0, format, (GLsizei) stream.format.width, (GLsizei) stream.format.height, 0, 0, 0 };
+            mTextureArrays.push_back(array);
+        }
+        stream.array_index = (int) a;
+        stream.array_layer = mTextureArrays[a].layers++;
+    }
+
+    std::vector<GLfloat> instances;
+    for (size_t a = 0; a < mTextureArrays.size(); a++) {
+        texture_array_t &array = mTextureArrays[a];
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, array.format, array.width, array.height, array.layers, 0, array.format,
+                     GL_UNSIGNED_BYTE, NULL);
+
+        array.firstInstance = (GLint) (instances.size() / INSTANCE_FLOATS);
+        for (size_t t = 0; t < mTileStreams.size(); t++) {
+            const stream_t &stream = *mStreams[mTileStreams[t]];
+            if (stream.array_index != (int) a)
+                continue;
+            // Corners 0 and 5 of the tile's triangles are opposite.
+            const GLfloat *vertices = &mTileVertices[t * 12];
+            const GLfloat *texCoords = &mTileTexCoords[t * 12];
+            const GLfloat instance[INSTANCE_FLOATS] = {
+                    vertices[0], vertices[1], vertices[10], vertices[11],
+                    texCoords[0], texCoords[1], texCoords[10], texCoords[11],
+                    (GLfloat) stream.array_layer
+            };
+            instances.insert(instances.end(), instance, instance + INSTANCE_FLOATS);
+        }
+        array.instances = (GLsizei) (instances.size() / INSTANCE_FLOATS) - array.firstInstance;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    if (mTextureArrays.empty())
+        return;
+
+    if (!mQuadBuffer) {
+        const GLfloat corners[] = { 0.0f, 0.0f,  1.0f, 0.0f,  0.0f, 1.0f,  1.0f, 1.0f };
+        glGenBuffers(1, &mQuadBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    }
+    if (!mInstanceBuffer)
+        glGenBuffers(1, &mInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(GLfloat), instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    LOGI("instanced: %zu streams in %zu texture arrays", mStreams.size(), mTextureArrays.size());
+}
 
-//    cv::Mat freadInputMat(freadbh,freadbw,CV_8UC1, rawData);
-    cv::Mat freadInputMat(freadbh,freadbw,CV_8UC4, rawData);
-    cv::imwrite("/storage/emulated/0/opencvTesting/freadInputMat.jpg", freadInputMat);
+// How often a stream can be halved on ingest and still cover every tile
+// showing it pixel for pixel, so uploads carry no more than is displayed.
+unsigned compositor::impl::downscaleLevelsFor(size_t streamIndex) {
+    const frame_format_t &format = mStreams[streamIndex]->source->format();
+    const GLint outW = outputWidth(), outH = outputHeight();
+    if (outW <= 0 || outH <= 0)
+        return 0;
+    uint32_t tileWidth = 0, tileHeight = 0;
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        if (mTileStreams[t] != streamIndex)
+            continue;
+        const tile_rect_t &rect = mTileRects[t];
+        tileWidth = std::max(tileWidth, (uint32_t) ceil(rect.width * outW));
+        tileHeight = std::max(tileHeight, (uint32_t) ceil(rect.height * outH));
+    }
+    unsigned levels = 0;
+    while (levels < max_downscale_levels(format, MAX_DOWNSCALE_LEVELS) &&
+           (format.width >> (levels + 1)) >= tileWidth && (format.height >> (levels + 1)) >= tileHeight) {
+        levels++;
+    }
+    return levels;
+}
 
-//    cv::Mat outputInRGBA(freadbh,freadbw, CV_8UC4);
-//    cv::cvtColor(freadInputMat,outputInRGBA,cv::COLOR_RGB2BGRA);
-//    cv::imwrite("/storage/emulated/0/opencvTesting/freadoutputInRGBA.jpg", outputInRGBA);
-//    cv::cvtColor(outputInRGBA,freadInputMat,cv::COLOR_BGRA2RGB);
+// (Re)starts the ingest thread of every stream with frames downscaled to the
+// current tile sizes, and packs the atlas for those sizes.
+void compositor::impl::startIngest() {
+    releaseSharedTextures();
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        stream_t &stream = *mStreams[s];
+        stopIngest(stream);
+        if (stream.source->frame_count() == 0)
+            continue;
+        const unsigned levels = downscaleLevelsFor(s);
+        stream.format = downscaled_format(stream.source->format(), levels);
+        stream.ingest.set_downscale(levels);
+        if (levels) {
+            LOGI("stream %s downscaled on ingest to %ux%u", stream.name.c_str(), stream.format.width,
+                 stream.format.height);
+        }
 
-   cv::Mat inputInMat = freadInputMat;
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_map1);
-//    glBindFramebuffer(GL_FRAMEBUFFER, iFrameBuffObject);
-//    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D, texture_map, 0);
+        // With PBO uploads the ingest thread writes straight into mapped buffers.
+        unsigned char *const *slotData = NULL;
+        if (mUploadMode == UPLOAD_PBO) {
+            if (!mGles3) {
+                LOGE("PBO uploads need OpenGL ES 3, uploading stream %s directly", stream.name.c_str());
+            } else if (stream.pbos.create(INGEST_RING_SLOTS, upload_frame_bytes(stream.format))) {
+                slotData = stream.pbos.mappings().data();
+            }
+        }
 
-//    cv::Mat inputInMat = cv::imread("/storage/emulated/0/opencvTesting/wp4473260.jpg",cv::IMREAD_COLOR);
-    if(inputInMat.empty())
-        LOGI("input matImage is empty");
+        // Playback of a recording: let the reader run ahead and wait when the ring is full.
+        // Containers are played at their recorded rate, headerless files as fast as drawn.
+        stream.ingest.start(stream.source.get(), INGEST_RING_SLOTS, RING_POLICY_BLOCK,
+                            mPaced ? stream.format.fps : 0.0, slotData);
+    }
+    if (mInstancedMode)
+        buildTextureArrays();
+    if (mAtlasMode)
+        buildAtlas();
+}
 
-    LOGI("width:[%d], height:[%d], Channels[%d] \n", inputInMat.cols,inputInMat.rows, inputInMat.channels());
+bool compositor::impl::openStreams(const stream_manifest_t &manifest) {
+    closeStreams();
+    size_t openedCount = 0;
+    for (size_t s = 0; s < manifest.streams.size(); s++) {
+        const stream_desc_t &desc = manifest.streams[s];
+        std::unique_ptr<stream_t> stream(new stream_t());
+        stream->name = desc.name;
+        stream->atlas_page = -1;
+        stream->array_index = -1;
+        stream->updated = false;
+        // A stream that fails to open keeps its tile, which stays black.
+        bool opened;
+        if (desc.format.width == 0) {
+            container_frame_source *container = new container_frame_source();
+            stream->source.reset(container);
+            opened = container->open(desc.path);
+        } else {
+            stream->source.reset(new mapped_frame_source());
+            opened = stream->source->open(desc.path, desc.format);
+        }
+        if (opened) {
+            openedCount++;
+        } else {
+            DPRINTF("can't open stream %s at %s", desc.name.c_str(), desc.path.c_str());
+        }
 
-    int bw = inputInMat.cols;
-    int bh = inputInMat.rows;
+        const pixel_format_t pixelFormat = stream->source->format().pixel_format;
+        const GLint filter = needsExactFetch(pixelFormat) ? GL_NEAREST : GL_LINEAR;
+        stream->texture.id = createStreamTexture(filter);
+        stream->uv_texture.id = createStreamTexture(filter);
+        if (isYuv10(pixelFormat) && !mGles3) {
+            LOGE("stream %s is 10-bit YUV, which needs OpenGL ES 3", desc.name.c_str());
+        }
+        stream->yuv_matrix = desc.yuv_matrix;
+        stream->format = stream->source->format();
+        stream->ingest.set_swap_red_blue(desc.bgr);
+        mStreams.push_back(std::move(stream));
+    }
+    mTileStreams = manifest.tile_streams;
+    mLayout = manifest.layout;
+    mOutputWidth = manifest.output_width;
+    mOutputHeight = manifest.output_height;
+    mPreview = manifest.preview;
+    mTopDown = manifest.top_down;
+    mComposite.release();
+    buildTileGeometry();
+    mUploadMode = manifest.upload;
+    mAtlasMode = manifest.atlas;
+    mInstancedMode = manifest.instanced;
+    startIngest();
+    mReadback = manifest.readback;
+    if (deepReadback() && !mGles3) {
+        LOGE("high bit depth read back needs OpenGL ES 3, reading back RGBA8");
+        mReadback = READBACK_RGBA8;
+    }
+    // Frames still in flight belong to the previous layout.
+    drainReadbacks();
+    mPackBuffers.release();
+    mReadbackMode = manifest.readback_mode;
+    if (mReadbackMode == READBACK_PBO && !mGles3) {
+        LOGE("pack buffers need OpenGL ES 3, reading back synchronously");
+        mReadbackMode = READBACK_SYNC;
+    }
+    mMonoOutput = true;
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        if (mStreams[s]->source->format().pixel_format != PIXEL_FORMAT_Y8)
+            mMonoOutput = false;
+    }
+    LOGI("opened %zu streams into %zu tiles", mStreams.size(), mTileStreams.size());
+    if (!openedCount)
+        LOGE("none of the %zu streams could be opened", mStreams.size());
+    return openedCount > 0;
+}
 
-//    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, bw, bh, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, inputInMat.data); //this is for grey input image
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bw, bh, 0, GL_RGB, GL_UNSIGNED_BYTE, inputInMat.data);
+static void uploadTexture(stream_texture_t &texture, GLint internalFormat, GLsizei width, GLsizei height,
+                          GLenum format, GLenum type, const void *data) {
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    texture.upload.begin();
+    if (texture.internalFormat != internalFormat || texture.width != width || texture.height != height) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, data);
+        texture.internalFormat = internalFormat;
+        texture.width = width;
+        texture.height = height;
+        texture.reallocations++;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data);
+    }
+    texture.upload.end();
+}
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture_map2);
-//    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 256, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, reverse_turbo_array_1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bw, bh, 0, GL_RGB, GL_UNSIGNED_BYTE, inputInMat.data);
+static void logReadStats(const char *path, stage_timer &read) {
+    if (read.count() < 60)
+        return;
+    LOGI("%s read back mean:[%lf] max:[%lf]msec", path, read.mean_ms(), read.max_ms());
+    read.reset();
+}
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, texture_map3);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bw, bh, 0, GL_RGB, GL_UNSIGNED_BYTE, inputInMat.data);
+static void logUploadStats(const std::string &name, const char *plane, stream_texture_t &texture) {
+    if (!texture.upload.count())
+        return;
+    LOGI("stream:[%s] %s upload mean:[%lf] max:[%lf]msec reallocations:[%llu]", name.c_str(), plane,
+         texture.upload.mean_ms(), texture.upload.max_ms(), (unsigned long long) texture.reallocations);
+    texture.upload.reset();
+}
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, texture_map4);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bw, bh, 0, GL_RGB, GL_UNSIGNED_BYTE, inputInMat.data);
+// Hands buffers whose uploads have completed back to the ingest thread, mapped
+// again. Fences signal in submission order, so this stops at the first busy one.
+static void reclaimUploadBuffers(stream_t &stream) {
+    while (!stream.in_flight.empty()) {
+        frame_slot_t *slot = stream.in_flight.front();
+        unsigned char *mapping = stream.pbos.try_reclaim(slot->slot_id);
+        if (!mapping)
+            break;
+        slot->data = mapping;
+        stream.ingest.release(slot);
+        stream.in_flight.erase(stream.in_flight.begin());
+    }
+}
 
+// Copies the outermost texels of a frame just uploaded to an atlas page into
+// the ring of texels around its rectangle, corners included; the page's own
+// edges are clamped anyway. With a pixel unpack buffer bound, data is an
+// offset into it, which only OpenGL ES 3 can read columns from.
+void compositor::impl::uploadAtlasBorder(const stream_t &stream, const atlas_texture_t &page,
+                                         const unsigned char *data) {
+    const GLint x = stream.atlas_x, y = stream.atlas_y;
+    const GLint w = stream.format.width, h = stream.format.height;
+    const size_t texelBytes = page.format == GL_RGBA ? 4 : 1;
+    const size_t rowBytes = texelBytes * w;
+    const bool below = y > 0, above = y + h < (GLint) page.size.height;
+    const bool left = x > 0, right = x + w < (GLint) page.size.width;
+    const unsigned char *lastRow = data + (h - 1) * rowBytes;
+    if (below)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y - 1, w, 1, page.format, GL_UNSIGNED_BYTE, data);
+    if (above)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y + h, w, 1, page.format, GL_UNSIGNED_BYTE, lastRow);
+
+    for (int side = 0; side < 2; side++) {
+        if (!(side ? right : left))
+            continue;
+        const GLint columnX = side ? x + w : x - 1;
+        const size_t offset = side ? rowBytes - texelBytes : 0;
+        if (mGles3) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, columnX, y, 1, h, page.format, GL_UNSIGNED_BYTE, data + offset);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            if (below)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, columnX, y - 1, 1, 1, page.format, GL_UNSIGNED_BYTE, data + offset);
+            if (above)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, columnX, y + h, 1, 1, page.format, GL_UNSIGNED_BYTE,
+                                lastRow + offset);
+            continue;
+        }
+        // The column and its corners in one upload.
+        const GLint rows = h + below + above;
+        mAtlasColumn.resize(rows * texelBytes);
+        unsigned char *dst = mAtlasColumn.data();
+        if (below) {
+            memcpy(dst, data + offset, texelBytes);
+            dst += texelBytes;
+        }
+        for (GLint r = 0; r < h; r++, dst += texelBytes)
+            memcpy(dst, data + r * rowBytes + offset, texelBytes);
+        if (above)
+            memcpy(dst, lastRow + offset, texelBytes);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, columnX, y - below, 1, rows, page.format, GL_UNSIGNED_BYTE,
+                        mAtlasColumn.data());
+    }
+}
 
-    glUseProgram(programId);
+// Uploads one packed frame into the stream's textures. NV12 goes up as is,
+// 1.5 bytes per pixel, and is converted to RGB by the tile shader. RGB24 was
+// expanded to RGBA by the ingest thread, which drivers take without converting.
+// With a pixel unpack buffer bound, data is NULL and the offsets address the
+// buffer.
+void compositor::impl::uploadStreamFrame(stream_t &stream, const unsigned char *data) {
+    const frame_format_t &format = stream.format;
+    if (stream.array_index >= 0) {
+        const texture_array_t &array = mTextureArrays[stream.array_index];
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        stream.texture.upload.begin();
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, stream.array_layer, format.width, format.height, 1,
+                        array.format, GL_UNSIGNED_BYTE, data);
+        stream.texture.upload.end();
+        return;
+    }
+    if (stream.atlas_page >= 0) {
+        // Only the stream's own sub-rectangle of the shared page changes.
+        const atlas_texture_t &page = mAtlasPages[stream.atlas_page];
+        glBindTexture(GL_TEXTURE_2D, page.id);
+        stream.texture.upload.begin();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, stream.atlas_x, stream.atlas_y, format.width, format.height, page.format,
+                        GL_UNSIGNED_BYTE, data);
+        uploadAtlasBorder(stream, page, data);
+        stream.texture.upload.end();
+        return;
+    }
+    switch (format.pixel_format) {
+        case PIXEL_FORMAT_RGB24:
+            uploadTexture(stream.texture, GL_RGBA, format.width, format.height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            break;
+        case PIXEL_FORMAT_Y8:
+            // Samples as (Y, Y, Y, 1), so the RGB tile program draws it unchanged.
+            uploadTexture(stream.texture, GL_LUMINANCE, format.width, format.height, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                          data);
+            break;
+        case PIXEL_FORMAT_NV12:
+            uploadTexture(stream.texture, GL_LUMINANCE, format.width, format.height, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                          data);
+            uploadTexture(stream.uv_texture, GL_LUMINANCE_ALPHA, format.width / 2, format.height / 2,
+                          GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, data + format.width * format.height);
+            break;
+        case PIXEL_FORMAT_MIPI10:
+            uploadTexture(stream.texture, GL_LUMINANCE, packed_row_bytes(format.width, format.pixel_format),
+                          format.height, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+            break;
+        case PIXEL_FORMAT_P010:
+            if (!mGles3)
+                break;
+            uploadTexture(stream.texture, GL_R16UI, format.width, format.height, GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+                          data);
+            uploadTexture(stream.uv_texture, GL_R16UI, format.width, format.height / 2, GL_RED_INTEGER,
+                          GL_UNSIGNED_SHORT, data + format.width * 2 * format.height);
+            break;
+        case PIXEL_FORMAT_TP10:
+            if (!mGles3)
+                break;
+            uploadTexture(stream.texture, GL_R32UI, format.width / 3, format.height, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                          data);
+            uploadTexture(stream.uv_texture, GL_R32UI, format.width / 3, format.height / 2, GL_RED_INTEGER,
+                          GL_UNSIGNED_INT, data + format.width / 3 * 4 * format.height);
+            break;
+    }
+}
 
-    glVertexAttribPointer(aPosition, 2, GL_FLOAT, GL_FALSE, 0, gTriangleVertices);
-    glEnableVertexAttribArray(aPosition);
+// The attributes keep reading from the tile buffer after it is unbound, so
+// other passes can still draw from client memory.
+void compositor::impl::setTileAttributes(GLint position, GLint texCoord) {
+    glBindBuffer(GL_ARRAY_BUFFER, mTileBuffer);
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, 0, (const void *) 0);
+    glEnableVertexAttribArray(position);
+
+    glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, 0,
+                          (const void *) (mTileVertices.size() * sizeof(GLfloat)));
+    glEnableVertexAttribArray(texCoord);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glVertexAttribPointer(aTexCoord, 2, GL_FLOAT, GL_FALSE, 0, gTexVertices);
-    glEnableVertexAttribArray(aTexCoord);
+// One draw per texture array, however many tiles it feeds.
+void compositor::impl::drawInstancedTiles() {
+    if (mTextureArrays.empty())
+        return;
+    const tile_program_t &program = mInstancedProgram;
+    glUseProgram(program.id);
+    glUniform1i(program.tileArray, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+    glVertexAttribPointer(program.aCorner, 2, GL_FLOAT, GL_FALSE, 0, (const void *) 0);
+    glEnableVertexAttribArray(program.aCorner);
+
+    const GLint perInstance[] = { program.aRect, program.aUvRect, program.aLayer };
+    const GLint sizes[] = { 4, 4, 1 };
+    const GLsizei stride = INSTANCE_FLOATS * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+    for (size_t a = 0; a < mTextureArrays.size(); a++) {
+        const texture_array_t &array = mTextureArrays[a];
+        if (!array.instances)
+            continue;
+        // ES 3.0 has no base instance, so the attributes start at the array's first one.
+        size_t offset = array.firstInstance * stride;
+        for (int i = 0; i < 3; i++) {
+            glVertexAttribPointer(perInstance[i], sizes[i], GL_FLOAT, GL_FALSE, stride, (const void *) offset);
+            glVertexAttribDivisor(perInstance[i], 1);
+            glEnableVertexAttribArray(perInstance[i]);
+            offset += sizes[i] * sizeof(GLfloat);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, array.instances);
+    }
+    // Divisors stick to the attribute index, which other programs reuse.
+    for (int i = 0; i < 3; i++) {
+        glVertexAttribDivisor(perInstance[i], 0);
+        glDisableVertexAttribArray(perInstance[i]);
+    }
+    glDisableVertexAttribArray(program.aCorner);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void compositor::impl::drawNv12Tiles() {
+    glUseProgram(mNv12Program.id);
+    setTileAttributes(mNv12Program.aPosition, mNv12Program.aTexCoord);
+    glUniform1i(mNv12Program.yTexture, 0);
+    glUniform1i(mNv12Program.uvTexture, 1);
+    glUniform3fv(mNv12Program.yuvOffset, 1, gYuvOffset);
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const stream_t &stream = *mStreams[mTileStreams[t]];
+        if (stream.source->format().pixel_format != PIXEL_FORMAT_NV12)
+            continue;
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, stream.uv_texture.id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, stream.texture.id);
+        glUniformMatrix3fv(mNv12Program.yuvMatrix, 1, GL_FALSE, yuvMatrixFor(stream.yuv_matrix));
+        glDrawArrays(GL_TRIANGLES, t * 6, 6);
+    }
+}
+
+void compositor::impl::drawMipi10Tiles() {
+    glUseProgram(mMipi10Program.id);
+    setTileAttributes(mMipi10Program.aPosition, mMipi10Program.aTexCoord);
+    glUniform1i(mMipi10Program.rawTexture, 0);
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const stream_t &stream = *mStreams[mTileStreams[t]];
+        const frame_format_t &format = stream.source->format();
+        if (format.pixel_format != PIXEL_FORMAT_MIPI10)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, stream.texture.id);
+        glUniform2f(mMipi10Program.rawSize, packed_row_bytes(format.width, format.pixel_format), format.height);
+        glUniform2f(mMipi10Program.quadCount, format.width / 2, format.height / 2);
+        glDrawArrays(GL_TRIANGLES, t * 6, 6);
+    }
+}
+
+void compositor::impl::drawYuv10Tiles() {
+    if (!mYuv10Program.id)
+        return;
+    glUseProgram(mYuv10Program.id);
+    setTileAttributes(mYuv10Program.aPosition, mYuv10Program.aTexCoord);
+    glUniform1i(mYuv10Program.yTexture, 0);
+    glUniform1i(mYuv10Program.uvTexture, 1);
+    glUniform3fv(mYuv10Program.yuvOffset, 1, gYuv10Offset);
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const stream_t &stream = *mStreams[mTileStreams[t]];
+        const frame_format_t &format = stream.source->format();
+        if (!isYuv10(format.pixel_format))
+            continue;
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, stream.uv_texture.id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, stream.texture.id);
+        glUniform1i(mYuv10Program.tp10, format.pixel_format == PIXEL_FORMAT_TP10);
+        glUniform2i(mYuv10Program.lumaSize, format.width, format.height);
+        glUniformMatrix3fv(mYuv10Program.yuvMatrix, 1, GL_FALSE, yuvMatrixFor(stream.yuv_matrix));
+        glDrawArrays(GL_TRIANGLES, t * 6, 6);
+    }
+}
 
-    glUniform2f(rubyTextureSize, bw, bh);
-    glUniform1i(rubyTexture1, 0);
-    glUniform1i(rubyTexture2, 1);
-    glUniform1i(rubyTexture3, 2);
-    glUniform1i(rubyTexture4, 3);
+// Output coordinates of a tile, rounded outwards.
+dirty_rect_t compositor::impl::tilePixels(size_t t) {
+    const GLfloat *vertices = &mTileVertices[t * 12];
+    const GLint outW = outputWidth(), outH = outputHeight();
+    dirty_rect_t rect;
+    rect.x0 = std::max(0, (GLint) floor((vertices[0] + 1.0f) * 0.5f * outW));
+    rect.y0 = std::max(0, (GLint) floor((std::min(vertices[1], vertices[11]) + 1.0f) * 0.5f * outH));
+    rect.x1 = std::min(outW, (GLint) ceil((vertices[10] + 1.0f) * 0.5f * outW));
+    rect.y1 = std::min(outH, (GLint) ceil((std::max(vertices[1], vertices[11]) + 1.0f) * 0.5f * outH));
+    return rect;
+}
+
+// Lists the regions whose content changed this tick: the tiles of updated
+// streams, merged into one box when there are many, or the whole output.
+void compositor::impl::collectDirtyRects(std::vector<dirty_rect_t> &rects) {
+    rects.clear();
+    const dirty_rect_t all = { 0, 0, outputWidth(), outputHeight() };
+    if (mRedrawAll) {
+        rects.push_back(all);
+        return;
+    }
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        if (!mStreams[mTileStreams[t]]->updated)
+            continue;
+        const dirty_rect_t rect = tilePixels(t);
+        if (rect.x0 < rect.x1 && rect.y0 < rect.y1)
+            rects.push_back(rect);
+    }
+    if (rects.size() > MAX_SCISSOR_RECTS) {
+        dirty_rect_t box = rects[0];
+        for (size_t r = 1; r < rects.size(); r++) {
+            box.x0 = std::min(box.x0, rects[r].x0);
+            box.y0 = std::min(box.y0, rects[r].y0);
+            box.x1 = std::max(box.x1, rects[r].x1);
+            box.y1 = std::max(box.y1, rects[r].y1);
+        }
+        rects.assign(1, box);
+    }
+}
+
+// Draws every tile. Tiles are grouped by input format so each program is bound once.
+void compositor::impl::drawTiles() {
+    glUseProgram(programId);
+    setTileAttributes(aPosition, aTexCoord);
+    glUniform1i(rubyTexture, 0);
 
     //if(rubyInputSize >= 0)
     //    glUniform2f(rubyInputSize, bw, bh);
     //if(rubyOutputSize >= 0)
     //    glUniform2f(rubyOutputSize, vw, vh);
 
-//    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glDrawArrays(GL_TRIANGLES, 0, 24);
-    static int i = 0;
-    /*
-    if ( i == 20) {
-        GLubyte *data = (GLubyte *) malloc(4 * scnw*scnh);
-        if (data) {
-            glReadPixels(0, 0, scnw, scnh, GL_RGBA, GL_UNSIGNED_BYTE, data);;
+    for (size_t t = 0; t < mTileStreams.size(); t++) {
+        const stream_t &stream = *mStreams[mTileStreams[t]];
+        if (!drawnByRgbProgram(stream.source->format().pixel_format) || stream.atlas_page >= 0 ||
+            stream.array_index >= 0)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, stream.texture.id);
+        glUniform2f(rubyTextureSize, stream.format.width, stream.format.height);
+        glDrawArrays(GL_TRIANGLES, t * 6, 6);
+    }
+    // Every tile on an atlas page goes out in one draw.
+    for (size_t p = 0; p < mAtlasPages.size(); p++) {
+        const atlas_texture_t &page = mAtlasPages[p];
+        if (page.indices.empty())
+            continue;
+        glBindTexture(GL_TEXTURE_2D, page.id);
+        glUniform2f(rubyTextureSize, page.size.width, page.size.height);
+        glDrawElements(GL_TRIANGLES, page.indices.size(), GL_UNSIGNED_SHORT, page.indices.data());
+    }
+    drawInstancedTiles();
+    drawNv12Tiles();
+    drawMipi10Tiles();
+    drawYuv10Tiles();
+}
+
+
+// Binds the offscreen composite, allocating it on first use, when tiles aren't
+// drawn straight into the window. The composite is only reallocated when the
+// output size changes, and is then redrawn whole.
+bool compositor::impl::bindComposite() {
+    if (!deepReadback() && !mOutputWidth && !mTopDown) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    const GLint outW = outputWidth(), outH = outputHeight();
+    if (!mComposite.valid() || (GLint) mComposite.width() != outW || (GLint) mComposite.height() != outH) {
+        bool created = false;
+        if (deepReadback()) {
+            created = mComposite.create(outW, outH, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT) ||
+                      (mReadback == READBACK_RGB10_A2 &&
+                       mComposite.create(outW, outH, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV));
+            if (!created) {
+                LOGE("no renderable high bit depth format, reading back RGBA8");
+                mReadback = READBACK_RGBA8;
+            }
         }
-        std::string filename("/storage/emulated/0/opencvTesting/image.rgb");
-        std::ofstream fout(filename, std::ios::binary);
-        fout.write((char *) data, 4 * scnw*scnh);
-        fout.close();
-        free(data);
-    }*/
-    i++;
-    //get the image from texture
-//    char *outBuffer = malloc(bw*bh*4);
-//    glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_UNSIGNED_BYTE,outBuffer); //glGetTexImage is not supported in GLES
+        if (!created && (mOutputWidth || mTopDown))
+            created = mComposite.create(outW, outH, mGles3 ? GL_RGBA8 : GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE);
+        if (!created) {
+            LOGE("can't create a %dx%d composite, drawing into the window", outW, outH);
+            mComposite.release();
+            // The window must show the tiles the right way up.
+            if (mTopDown) {
+                mTopDown = false;
+                buildTileGeometry();
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return false;
+        }
+        mRedrawAll = true;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, mComposite.framebuffer());
+    glViewport(0, 0, outW, outH);
+    return true;
+}
+
+// Draws a texture over the whole viewport with the user's shader, where
+// OpenGL ES 2 has no framebuffer blit, optionally upside down.
+void compositor::impl::drawTextureQuad(GLuint texture, GLint width, GLint height, bool flipY) {
+    static const GLfloat positions[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    static const GLfloat texCoords[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+    static const GLfloat flippedTexCoords[] = { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+    glUseProgram(programId);
+    glVertexAttribPointer(aPosition, 2, GL_FLOAT, GL_FALSE, 0, positions);
+    glEnableVertexAttribArray(aPosition);
+    glVertexAttribPointer(aTexCoord, 2, GL_FLOAT, GL_FALSE, 0, flipY ? flippedTexCoords : texCoords);
+    glEnableVertexAttribArray(aTexCoord);
+    glUniform1i(rubyTexture, 0);
+    glUniform2f(rubyTextureSize, width, height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// Shows the composite in the window, scaled to fit with its aspect ratio kept,
+// unless the preview is off. Leaves the window bound.
+void compositor::impl::presentComposite() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, scnw, scnh);
+    if (!mPreview || scnw <= 0 || scnh <= 0)
+        return;
+    const GLint outW = mComposite.width(), outH = mComposite.height();
+    GLint dstW = scnw, dstH = scnh;
+    if ((int64_t) outW * scnh > (int64_t) outH * scnw)
+        dstH = (GLint) ((int64_t) scnw * outH / outW);
+    else
+        dstW = (GLint) ((int64_t) scnh * outW / outH);
+    const GLint dstX = (scnw - dstW) / 2, dstY = (scnh - dstH) / 2;
+    if (dstW != scnw || dstH != scnh) {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    if (mGles3) {
+        // A top-down composite is turned the right way up by swapping the destination rows.
+        const GLint dstY0 = mTopDown ? dstY + dstH : dstY, dstY1 = mTopDown ? dstY : dstY + dstH;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mComposite.framebuffer());
+        glBlitFramebuffer(0, 0, outW, outH, dstX, dstY0, dstX + dstW, dstY1, GL_COLOR_BUFFER_BIT,
+                          dstW == outW && dstH == outH ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    } else {
+        glViewport(dstX, dstY, dstW, dstH);
+        drawTextureQuad(mComposite.texture(), outW, outH, mTopDown);
+        glViewport(0, 0, scnw, scnh);
+    }
+}
+
+// Appends a frame read back to the output file, top row first. Returns false
+// when there is no output file.
+bool compositor::impl::writeOutputFrame(const unsigned char *data, size_t rowBytes, int rows, bool topDown) {
+    if (!mOutput.is_open())
+        return false;
+    if (topDown) {
+        mOutput.write((const char *) data, rowBytes * rows);
+        return true;
+    }
+    for (int y = rows - 1; y >= 0; y--) {
+        mOutput.write((const char *) data + (size_t) y * rowBytes, rowBytes);
+    }
+    return true;
+}
+
+// Splits NV12 rows, a Y plane of two thirds of them and then the UV plane, into
+// the planes of an image.
+static void fillNv12Image(const unsigned char *data, size_t width, size_t rows, nv12_image_t &image) {
+    const size_t yBytes = width * (rows / 3 * 2);
+    image.y_width = (uint32_t) width;
+    image.y_height = (uint32_t) (rows / 3 * 2);
+    image.y_plane.assign(data, data + yBytes);
+    image.uv_plane.assign(data + yBytes, data + width * rows);
+}
 
-    //dump output
-    uint32_t* readPixels;
-    readPixels = new uint32_t[bw * bh];
-    glReadStartTime= std::chrono::high_resolution_clock::now();
-    glReadPixels(0, 0, bw, bh, GL_RGBA, GL_UNSIGNED_BYTE, readPixels);
-    glReadEndTime = std::chrono::high_resolution_clock::now();
-    LOGI("glReadPixel Operation Time:[%lf]msec",std::chrono::duration<double, std::milli>(glReadEndTime-glReadStartTime).count());
+bool compositor_frame_to_nv12(const compositor_frame_t &frame, nv12_image_t &image) {
+    if (frame.pixels != COMPOSITOR_PIXELS_NV12 || !frame.data)
+        return false;
+    fillNv12Image(frame.data, frame.row_bytes, frame.rows, image);
+    return true;
+}
 
-    cv::Mat outputReadpixelInMat = cv::Mat(inputInMat.rows,inputInMat.cols,CV_8UC4,readPixels);
+// Runs on the encode thread: passes a read back to the callback and the pull
+// queue, then appends it to the output file, or dumps it for inspection.
+void compositor::impl::encodeFrame(const encode_frame_t &frame) {
+    const unsigned char *data = frame.buffer.data();
+    if (mFrameCallback || mPullDepth) {
+        compositor_frame_t delivered;
+        delivered.frame_id = frame.frame_index;
+        delivered.pixels = (compositor_pixels_t) frame.kind;
+        delivered.data = data;
+        delivered.row_bytes = frame.row_bytes;
+        delivered.rows = frame.rows;
+        delivered.top_down = frame.top_down;
+        delivered.buffer = frame.buffer;
+        if (mFrameCallback)
+            mFrameCallback(delivered);
+        keepForPull(delivered);
+    }
+    if (writeOutputFrame(data, frame.row_bytes, (int) frame.rows, frame.top_down))
+        return;
+
+#ifdef HAVE_OPENCV
+    if (frame.kind != COMPOSITOR_PIXELS_RGBA8 && frame.kind != COMPOSITOR_PIXELS_LUMA8) {
+        const char *filename = frame.kind == COMPOSITOR_PIXELS_RGB10_A2 ? "/storage/emulated/0/opencvTesting/outputReadpixel.rgb10a2"
+                             : frame.kind == COMPOSITOR_PIXELS_RGBA16F ? "/storage/emulated/0/opencvTesting/outputReadpixel.rgba16f"
+                             : frame.kind == COMPOSITOR_PIXELS_NV12 ? "/storage/emulated/0/opencvTesting/outputReadpixel.nv12"
+                             : "/storage/emulated/0/opencvTesting/outputReadpixel.rgba32f";
+        std::ofstream fout(filename, std::ios::binary);
+        fout.write((const char *) data, frame.row_bytes * frame.rows);
+        return;
+    }
+
+    const bool luma = frame.kind == COMPOSITOR_PIXELS_LUMA8;
+    cv::Mat outputReadpixelInMat((int) frame.rows, (int) frame.row_bytes / (luma ? 1 : 4), luma ? CV_8UC1 : CV_8UC4,
+                                 (void *) data);
     if(outputReadpixelInMat.empty())
-        LOGI("outputReadpixelInMat inputInMat empty");
+        LOGI("outputReadpixelInMat empty");
 
     cv::imwrite("/storage/emulated/0/opencvTesting/outputReadpixelInMat.jpg", outputReadpixelInMat);
-    cv::Mat flippedMat(outputReadpixelInMat.rows,outputReadpixelInMat.cols,CV_8UC4);
-    FlipStartTime = std::chrono::high_resolution_clock::now();
+    // Rows already read back top row first need no flip.
+    if (frame.top_down)
+        return;
+    cv::Mat flippedMat(outputReadpixelInMat.rows,outputReadpixelInMat.cols,outputReadpixelInMat.type());
+    std::chrono::high_resolution_clock::time_point FlipStartTime = std::chrono::high_resolution_clock::now();
     cv::flip(outputReadpixelInMat, flippedMat, 0);
-    FlipEndTime = std::chrono::high_resolution_clock::now();
+    std::chrono::high_resolution_clock::time_point FlipEndTime = std::chrono::high_resolution_clock::now();
     LOGI("flip Operation Time:[%lf]msec",std::chrono::duration<double, std::milli>(FlipEndTime-FlipStartTime).count());
 
     cv::imwrite("/storage/emulated/0/opencvTesting/outputReadpixelInFlippedMat.jpg", flippedMat);
+#endif
+}
+
+// Takes a pooled buffer of bytes to read the next frame into. Returns an empty
+// handle if consumers hold every one.
+readback_buffer compositor::impl::acquireReadback(size_t bytes) {
+    if (!mEncoder.running())
+        mEncoder.start([this](const encode_frame_t &frame) { encodeFrame(frame); }, ENCODE_QUEUE_DEPTH);
+    // Enough buffers that only consumers holding frames for long run out: on
+    // top of theirs, one per pack buffer in flight and the last frame read.
+    const size_t buffers = ENCODE_QUEUE_DEPTH + mPullDepth + HELD_READBACKS + PACK_BUFFER_COUNT + 1;
+    if (mReadbackPool.buffer_bytes() != bytes || mReadbackBuffers != buffers) {
+        mReadbackPool.reserve(buffers, bytes);
+        mReadbackBuffers = buffers;
+    }
+    readback_buffer buffer = mReadbackPool.try_acquire();
+    if (!buffer.valid()) {
+        // The encoder hands its buffers back once it has caught up.
+        mEncoder.flush();
+        buffer = mReadbackPool.try_acquire();
+    }
+    return buffer;
+}
+
+// Copies rows y0 to y1 of previous, the frame read back before dst at the same
+// depth, into dst, or clears them if there is none.
+static void copyPreviousRows(unsigned char *dst, const readback_buffer &previous, size_t rowBytes, int y0, int y1) {
+    const size_t offset = (size_t) y0 * rowBytes;
+    const size_t bytes = (size_t) (y1 - y0) * rowBytes;
+    if (previous.valid())
+        memcpy(dst + offset, previous.data() + offset, bytes);
+    else
+        memset(dst + offset, 0, bytes);
+}
+
+// Closes up rows y0 to y1, read back readRowBytes apart, to rowBytes apart in
+// place. Each row only moves down, below where the rows after it start.
+static void compactRows(unsigned char *data, size_t rowBytes, size_t readRowBytes, int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+        memmove(data + y * rowBytes, data + y * readRowBytes, rowBytes);
+    }
+}
+
+// Hands a frame read back into a pooled buffer to the encode thread.
+void compositor::impl::submitReadback(const readback_buffer &buffer, size_t rowBytes, int rows,
+                                      compositor_pixels_t pixels, uint64_t frameId) {
+    encode_frame_t *frame = mEncoder.acquire();
+    frame->buffer = buffer;
+    frame->row_bytes = rowBytes;
+    frame->rows = rows;
+    frame->kind = pixels;
+    frame->frame_index = frameId;
+    // NV12 is packed top row first whichever way up the composite is.
+    frame->top_down = mTopDown || pixels == COMPOSITOR_PIXELS_NV12;
+    mEncoder.submit(frame);
+}
+
+// Hands on the oldest read back in flight in a pack buffer if the GPU has
+// written it, or once it has with wait. Returns false if it is still in flight.
+bool compositor::impl::completeOldestReadback(bool wait) {
+    const size_t count = mPackBuffers.count();
+    const size_t buffer = (mNextPackBuffer + count - mPendingCount) % count;
+    pending_readback_t &pending = mPendingReadbacks[buffer];
+    const size_t offset = (size_t) pending.y0 * pending.readRowBytes;
+    const size_t bytes = (size_t) (pending.y1 - pending.y0) * pending.readRowBytes;
+    const unsigned char *rows = mPackBuffers.try_map(buffer, offset, bytes, wait);
+    if (!rows && !wait)
+        return false;
+    // The frame before this one has landed too, so its rows are complete.
+    unsigned char *frame = pending.buffer.data();
+    copyPreviousRows(frame, pending.previous, pending.rowBytes, 0, pending.y0);
+    copyPreviousRows(frame, pending.previous, pending.rowBytes, pending.y1, pending.rows);
+    if (rows) {
+        if (pending.readRowBytes == pending.rowBytes) {
+            memcpy(frame + offset, rows, bytes);
+        } else {
+            for (int y = pending.y0; y < pending.y1; y++) {
+                memcpy(frame + y * pending.rowBytes, rows + (y - pending.y0) * pending.readRowBytes,
+                       pending.rowBytes);
+            }
+        }
+        mPackBuffers.unmap(buffer);
+        submitReadback(pending.buffer, pending.rowBytes, pending.rows, pending.pixels, pending.frameId);
+    } else {
+        LOGE("can't map the pack buffer of frame %llu", (unsigned long long) pending.frameId);
+        // Later frames take their unchanged rows from this one.
+        copyPreviousRows(frame, pending.previous, pending.rowBytes, pending.y0, pending.y1);
+    }
+    pending.buffer.release();
+    pending.previous.release();
+    --mPendingCount;
+    return true;
+}
+
+// Hands on every read back that has landed, in order, without waiting.
+void compositor::impl::collectReadbacks() {
+    while (mPendingCount && completeOldestReadback(false)) {
+    }
+}
+
+// Waits for every read back in flight and hands it on.
+void compositor::impl::drainReadbacks() {
+    while (mPendingCount) {
+        completeOldestReadback(true);
+    }
+}
+
+// Reads rows y0 to y1 of a frame of rows x rowBytes, bottom row first, into a
+// pooled buffer, takes the other rows from the last frame read into frame, and
+// hands the buffer to the encode thread. read issues the glReadPixels of those
+// rows into dst. With READBACK_PBO, dst is an offset into a pack buffer and the
+// frame is only handed on once the GPU has written it, from collectReadbacks()
+// on a later tick. read may deliver its rows readRowBytes apart, e.g. from a
+// pack pass that rounds the width up; only the first rowBytes of each are kept.
+template <typename Read>
+bool compositor::impl::readRows(readback_rows_t &frame, size_t rowBytes, int rows, int y0, int y1,
+                                compositor_pixels_t pixels, uint64_t frameId, const Read &read,
+                                size_t readRowBytes) {
+    if (!readRowBytes)
+        readRowBytes = rowBytes;
+    const size_t bytes = readRowBytes * rows;
+    const size_t offset = (size_t) y0 * readRowBytes;
+    // Readbacks still in flight were issued into the old pack buffers, so
+    // they land before the ring is rebuilt.
+    if (mReadbackMode == READBACK_PBO && mPackBuffers.buffer_bytes() != bytes) {
+        drainReadbacks();
+        mNextPackBuffer = 0;
+        if (mPackBuffers.create(PACK_BUFFER_COUNT, bytes)) {
+            mPendingReadbacks.resize(mPackBuffers.count());
+        } else {
+            LOGE("reading back synchronously");
+            mReadbackMode = READBACK_SYNC;
+        }
+    }
+    // Every buffer is in flight: the GPU is a whole ring behind.
+    if (mReadbackMode == READBACK_PBO && mPendingCount == mPackBuffers.count())
+        completeOldestReadback(true);
+
+    readback_buffer target = acquireReadback(bytes);
+    if (!target.valid()) {
+        LOGE("dropped frame %llu: consumers hold every read back buffer", (unsigned long long) frameId);
+        ++mStages.dropped;
+        // The rows it would have refreshed are lost, so the next tick reads them all.
+        frame.last.release();
+        mRedrawAll = true;
+        return true;
+    }
+    readback_buffer previous;
+    if (frame.bytes == rowBytes * rows)
+        previous = frame.last;
+    frame.last = target;
+    frame.bytes = rowBytes * rows;
+    if (mReadbackMode != READBACK_PBO) {
+        if (!read(target.data() + offset)) {
+            frame.last.release();
+            return false;
+        }
+        if (readRowBytes != rowBytes)
+            compactRows(target.data(), rowBytes, readRowBytes, y0, y1);
+        copyPreviousRows(target.data(), previous, rowBytes, 0, y0);
+        copyPreviousRows(target.data(), previous, rowBytes, y1, rows);
+        submitReadback(target, rowBytes, rows, pixels, frameId);
+        return true;
+    }
+
+    const size_t buffer = mNextPackBuffer;
+    mPackBuffers.bind_for_read(buffer);
+    const bool issued = read(reinterpret_cast<unsigned char *>(offset));
+    mPackBuffers.fence(buffer);
+    if (!issued) {
+        frame.last.release();
+        return false;
+    }
+    // Only advanced past buffers that hold a pending frame, so the next one
+    // is never still in flight.
+    mNextPackBuffer = (buffer + 1) % mPackBuffers.count();
+    const pending_readback_t pending = { frameId, pixels, target, previous, rowBytes, readRowBytes, rows, y0, y1 };
+    mPendingReadbacks[buffer] = pending;
+    ++mPendingCount;
+    return true;
+}
+
+// Waits for every frame read back so far to be written.
+void compositor::impl::flush() {
+    drainReadbacks();
+    mEncoder.flush();
+    mStages.encode = mEncoder.encode();
+    if (mOutput.is_open())
+        mOutput.flush();
+}
+
+// High bit depth formats composite offscreen in half float.
+bool compositor::impl::deepReadback() const {
+    return mReadback == READBACK_RGB10_A2 || mReadback == READBACK_RGBA16F;
+}
+
+// Reads back rows y0 to y1 of the bottom-left bw x bh of the composite at the
+// configured depth, keeping the other rows from earlier ticks, and dumps it
+// raw, bottom row first.
+bool compositor::impl::readBackDeep(int bw, int bh, int y0, int y1, uint64_t frameId) {
+    if (!deepReadback() || !mComposite.valid())
+        return false;
+    bw = std::min(bw, (int) mComposite.width());
+    bh = std::min(bh, (int) mComposite.height());
+    y1 = std::min(y1, bh);
+    if (y0 >= y1)
+        return true;
+
+    mDeepRead.begin();
+    bool read;
+    if (mReadback == READBACK_RGB10_A2) {
+        if (mComposite.internal_format() == GL_RGB10_A2) {
+            glBindFramebuffer(GL_FRAMEBUFFER, mComposite.framebuffer());
+        } else {
+            if (!mReadback10.create(bw, bh, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV))
+                return false;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, mComposite.framebuffer());
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mReadback10.framebuffer());
+            glBlitFramebuffer(0, y0, bw, y1, 0, y0, bw, y1, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, mReadback10.framebuffer());
+        }
+        read = readRows(mDeepReadback, (size_t) bw * 4, bh, y0, y1, COMPOSITOR_PIXELS_RGB10_A2, frameId,
+                        [&](unsigned char *dst) {
+            glReadPixels(0, y0, bw, y1 - y0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, dst);
+            return true;
+        });
+    } else {
+        // Half floats when the driver offers them, otherwise the always-supported full floats.
+        glBindFramebuffer(GL_FRAMEBUFFER, mComposite.framebuffer());
+        GLint readType = GL_FLOAT;
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &readType);
+        if (readType != GL_HALF_FLOAT)
+            readType = GL_FLOAT;
+        const size_t rowBytes = (size_t) bw * 4 * (readType == GL_HALF_FLOAT ? 2 : 4);
+        read = readRows(mDeepReadback, rowBytes, bh, y0, y1,
+                        readType == GL_HALF_FLOAT ? COMPOSITOR_PIXELS_RGBA16F : COMPOSITOR_PIXELS_RGBA32F, frameId,
+                        [&](unsigned char *dst) {
+            glReadPixels(0, y0, bw, y1 - y0, GL_RGBA, readType, dst);
+            return true;
+        });
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    mDeepRead.end();
+    logReadStats("deep", mDeepRead);
+    return read;
+}
+
+// Copies the bottom-left bw x bh of the bound framebuffer into mCompositeTexture
+// for a pack pass to sample.
+GLuint compositor::impl::copyToCompositeTexture(GLenum internalFormat, int bw, int bh) {
+    if (!mCompositeTexture) {
+        glGenTextures(1, &mCompositeTexture);
+        glBindTexture(GL_TEXTURE_2D, mCompositeTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mCompositeTexture);
+    glCopyTexImage2D(GL_TEXTURE_2D, 0, internalFormat, 0, 0, bw, bh, 0);
+    return mCompositeTexture;
+}
+
+// Reads back the bottom-left bw x bh of the composite as 8-bit luminance. The
+// pack pass works on four pixels at a time, so a width that isn't a multiple
+// of 4 is packed rounded up and the extra pixels of each row are dropped.
+bool compositor::impl::readBackLuma(int bw, int bh, uint64_t frameId) {
+    const int packWidth = (bw + 3) & ~3;
+
+    mLumaRead.begin();
+    copyToCompositeTexture(GL_LUMINANCE, packWidth, bh);
+    const bool read = readRows(mMonoReadback, bw, bh, 0, bh, COMPOSITOR_PIXELS_LUMA8, frameId,
+                               [&](unsigned char *dst) {
+        return mPackPass.read_luma(mCompositeTexture, packWidth, bh, dst);
+    }, packWidth);
+    mLumaRead.end();
+    logReadStats("luma", mLumaRead);
+    return read;
+}
+
+// Reads back the bottom-left bw x bh of the output as NV12, which mPackPass
+// converts and packs on the GPU, so the read moves 1.5 bytes per pixel
+// instead of 4 and the CPU converts nothing. A composite of exactly that size
+// is sampled in place; anything else is copied out first.
+bool compositor::impl::readBackNv12(int bw, int bh, bool offscreen, uint64_t frameId) {
+    if (bw % 4 != 0 || bh % 2 != 0) {
+        LOGE("NV12 needs a width that is a multiple of 4 and an even height, not %dx%d; reading back RGBA8", bw, bh);
+        mReadback = READBACK_RGBA8;
+        return false;
+    }
+
+    mNv12Read.begin();
+    const GLuint source = offscreen && (GLint) mComposite.width() == bw && (GLint) mComposite.height() == bh
+                          ? mComposite.texture() : copyToCompositeTexture(GL_RGB, bw, bh);
+    const int rows = bh + bh / 2;
+    const bool read = readRows(mNv12Readback, bw, rows, 0, rows, COMPOSITOR_PIXELS_NV12, frameId,
+                               [&](unsigned char *dst) {
+        return mPackPass.read_nv12(source, bw, bh, mTopDown, dst);
+    });
+    mNv12Read.end();
+    logReadStats("nv12", mNv12Read);
+    return read;
+}
+// Reads back rows readY0 to readY1 of the bottom-left bw x bh of the output
+// and dumps it.
+void compositor::impl::readBackFrame(int bw, int bh, int readY0, int readY1, bool offscreen) {
+    const uint64_t frameId = mReadBackCount++;
+    if (mPackBuffers.in_flight().count() >= 60) {
+        LOGI("read back in flight mean:[%lf] max:[%lf]msec", mPackBuffers.in_flight().mean_ms(),
+             mPackBuffers.in_flight().max_ms());
+        mPackBuffers.in_flight().reset();
+    }
+    if (readBackDeep(bw, bh, readY0, readY1, frameId))
+        return;
+    // Read the composite, not the preview.
+    if (offscreen)
+        glBindFramebuffer(GL_FRAMEBUFFER, mComposite.framebuffer());
+    if (mReadback == READBACK_NV12 && readBackNv12(bw, bh, offscreen, frameId))
+        return;
+    if (mMonoOutput && readBackLuma(bw, bh, frameId))
+        return;
+    //get the image from texture
+//    char *outBuffer = malloc(bw*bh*4);
+//    glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_UNSIGNED_BYTE,outBuffer); //glGetTexImage is not supported in GLES
+
+    //dump output, refreshing only the rows that changed
+    readY1 = std::min(readY1, bh);
+    mRgbaRead.begin();
+    readRows(mReadPixels, (size_t) bw * 4, bh, readY0, readY1, COMPOSITOR_PIXELS_RGBA8, frameId,
+             [&](unsigned char *readPixels) {
+        glReadPixels(0, readY0, bw, readY1 - readY0, GL_RGBA, GL_UNSIGNED_BYTE, readPixels);
+        return true;
+    });
+    mRgbaRead.end();
+    logReadStats("rgba", mRgbaRead);
+}
+
+// Returns true if any stream advanced, i.e. a new frame was composited.
+bool compositor::impl::renderFrame() // 16.6ms
+{
+    float grey;
+    grey = 0.00f;
+
+    applyPullQueue();
+    // Hand on the read backs of earlier ticks that have landed by now.
+    collectReadbacks();
+
+    const bool offscreen = bindComposite();
+    glClearColor(grey, grey, grey, 1.0f);
+    if(mStreams.empty()) {
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        DPRINTF("no input streams");
+        if (offscreen)
+            presentComposite();
+        return false;
+    }
+
+    // Each stream is uploaded once per frame, however many tiles show it.
+    glActiveTexture(GL_TEXTURE0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    mStages.upload.begin();
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        stream_t &stream = *mStreams[s];
+        const bool pbo = stream.pbos.count() != 0;
+        if (pbo)
+            reclaimUploadBuffers(stream);
+        // Only take frames the ingest thread already has in memory; on underrun or
+        // at end of stream the texture keeps the previous frame.
+        frame_slot_t *slot = stream.ingest.try_pop();
+        if (!slot) {
+            continue;
+        }
+        if (slot->frame_index % 60 == 0) {
+            ring_stats_t stats = stream.ingest.stats();
+            LOGI("stream:[%s] frame:[%zu] underruns:[%llu] drops:[%llu]", stream.name.c_str(), slot->frame_index,
+                 (unsigned long long) stats.underruns, (unsigned long long) stats.dropped);
+            logUploadStats(stream.name, "y", stream.texture);
+            logUploadStats(stream.name, "uv", stream.uv_texture);
+            if (pbo && stream.pbos.in_flight().count()) {
+                LOGI("stream:[%s] pbo in flight mean:[%lf] max:[%lf]msec", stream.name.c_str(),
+                     stream.pbos.in_flight().mean_ms(), stream.pbos.in_flight().max_ms());
+                stream.pbos.in_flight().reset();
+            }
+        }
+#ifdef HAVE_OPENCV
+        // Mapped unpack buffers are write-only, so there is nothing to dump from them.
+        const frame_format_t &format = stream.format;
+        if (s == 0 && !pbo && !mOutput.is_open() && drawnByRgbProgram(format.pixel_format)) {
+            cv::Mat freadInputMat(format.height, format.width,
+                                  format.pixel_format == PIXEL_FORMAT_Y8 ? CV_8UC1 : CV_8UC4, slot->data);
+            cv::imwrite("/storage/emulated/0/opencvTesting/freadInputMat.jpg", freadInputMat);
+        }
+#endif
+
+//    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, bw, bh, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, inputInMat.data); //this is for grey input image
+        if (pbo) {
+            // The copy runs asynchronously; the slot goes back once its fence signals.
+            if (stream.pbos.bind_for_upload(slot->slot_id)) {
+                uploadStreamFrame(stream, NULL);
+                stream.pbos.fence(slot->slot_id);
+                stream.updated = true;
+            }
+            stream.in_flight.push_back(slot);
+            continue;
+        }
+        uploadStreamFrame(stream, slot->data);
+        stream.updated = true;
+        // The upload has copied the frame, so the slot can be refilled already.
+        stream.ingest.release(slot);
+    }
+    mStages.upload.end();
+    bool advanced = false;
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        advanced = advanced || mStreams[s]->updated;
+    }
 
+    // The read back covers the configured output, or else keeps the size of the first stream.
+    int bw = mOutputWidth ? mOutputWidth : mStreams[0]->source->format().width;
+    int bh = mOutputHeight ? mOutputHeight : mStreams[0]->source->format().height;
+
+    // Redraw what changed. A target that doesn't keep its contents is redrawn
+    // whole, but the read back still only covers what changed.
+    mStages.draw.begin();
+    const std::vector<dirty_rect_t> &dirty = mDirtyRects;
+    collectDirtyRects(mDirtyRects);
+    const bool persistent = offscreen || mPreservedSurface;
+    const dirty_rect_t all = { 0, 0, outputWidth(), outputHeight() };
+    const dirty_rect_t *redraw = persistent ? dirty.data() : &all;
+    const size_t redrawCount = persistent ? dirty.size() : 1;
+    glEnable(GL_SCISSOR_TEST);
+    for (size_t r = 0; r < redrawCount; r++) {
+        // Every tile is drawn; the scissor discards all but the dirty pixels.
+        glScissor(redraw[r].x0, redraw[r].y0, redraw[r].x1 - redraw[r].x0, redraw[r].y1 - redraw[r].y0);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        drawTiles();
+    }
+    glDisable(GL_SCISSOR_TEST);
+    mRedrawAll = false;
+    int readY0 = outputHeight(), readY1 = 0;
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        mStreams[s]->updated = false;
+    }
+    for (size_t r = 0; r < dirty.size(); r++) {
+        readY0 = std::min(readY0, (int) dirty[r].y0);
+        readY1 = std::max(readY1, (int) dirty[r].y1);
+    }
+    if (offscreen)
+        presentComposite();
+    mStages.draw.end();
+    if (readY0 >= std::min(readY1, bh))
+        return advanced;
+    mStages.readback.begin();
+    readBackFrame(bw, bh, readY0, readY1, offscreen);
+    mStages.readback.end();
+    return advanced;
 }
 
-void _init(JNIEnv *env, jobject bmp) {
+void compositor::impl::initContext() {
     printGLString("Version", GL_VERSION);
     printGLString("Vendor", GL_VENDOR);
     printGLString("Renderer", GL_RENDERER);
     printGLString("Extensions", GL_EXTENSIONS);
+    mGles3 = strncmp((const char *) glGetString(GL_VERSION), "OpenGL ES 3", 11) == 0;
 
-    //AndroidBitmapInfo info;
-    //AndroidBitmap_getInfo(env, bmp, &info);
-    //bw = info.width;
-    //bh = info.height;
-    //AndroidBitmap_lockPixels(env, bmp, &img);
 //    glGenFramebuffers(1, &iFrameBuffObject);
 //    glBindFramebuffer(GL_FRAMEBUFFER, iFrameBuffObject);
-    glGenTextures(1, &texture_map1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_map1);
 
-//    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D, texture_map, 0);
+}
 
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+bool compositor::impl::init(const std::string &manifest_path) {
+    initContext();
+    DPRINTF("read input streams");
+    stream_manifest_t manifest;
+    if (!load_stream_manifest(manifest_path, manifest)) {
+        LOGE("can't load the manifest %s", manifest_path.c_str());
+        return false;
+    }
+    return openStreams(manifest);
+}
 
-    glGenTextures(1, &texture_map2);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture_map2);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+// Shows the single recording on the device in a 2x2 grid, uploaded once.
+bool compositor::impl::initDefault() {
+    initContext();
+//    std::string FileName = std::string("/storage/emulated/0/opencvTesting/tina60-120");
+    std::string FileName = std::string("/storage/emulated/0/opencvTesting/videoFrmImouInrawrgb24short.rgb");
+    stream_manifest_t manifest;
+    stream_desc_t desc;
+    desc.name = "input";
+    desc.path = FileName;
+    desc.format = make_frame_format(1920, 1080, PIXEL_FORMAT_RGB24);
+    desc.yuv_matrix = YUV_MATRIX_BT601;
+    desc.bgr = false;
+    manifest.streams.assign(1, desc);
+    manifest.tile_streams.assign(4, 0);
+    manifest.readback = READBACK_RGBA8;
+    manifest.readback_mode = READBACK_SYNC;
+    manifest.upload = UPLOAD_DIRECT;
+    manifest.atlas = false;
+    manifest.instanced = false;
+    manifest.layout = make_grid_layout();
+    manifest.output_width = 0;
+    manifest.output_height = 0;
+    manifest.preview = true;
+    manifest.top_down = false;
+    return openStreams(manifest);
+}
 
-    glGenTextures(1, &texture_map3);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, texture_map3);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+// Frees the user's shader sources; the built-in ones are string literals.
+void compositor::impl::freeShaderSources() {
+    if (mVs != gVertexShader)
+        free(mVs);
+    if (mFs != gFragmentShader)
+        free(mFs);
+    mVs = NULL;
+    mFs = NULL;
+}
 
-    glGenTextures(1, &texture_map4);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, texture_map4);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+bool compositor::impl::loadShaderSources(const char *vertex_source, const char *fragment_source) {
+    freeShaderSources();
+    mVs = vertex_source ? strdup(vertex_source) : (char *)gVertexShader;
+    mFs = fragment_source ? strdup(fragment_source) : (char *)gFragmentShader;
+    return initProgram();
+}
 
-    DPRINTF("read input file");
-//    std::string FileName = std::string("/storage/emulated/0/opencvTesting/tina60-120");
-    std::string FileName = std::string("/storage/emulated/0/opencvTesting/videoFrmImouInrawrgb24short.rgb");
-    fp = fopen(FileName.c_str(),"r+b");
-    if(NULL == fp) {
-            DPRINTF(" fopen() Error!!!\n");
+bool compositor::impl::finished() const {
+    for (size_t s = 0; s < mStreams.size(); s++) {
+        const stream_t &stream = *mStreams[s];
+        if (stream.source->frame_count() != 0 && (!stream.ingest.finished() || !stream.in_flight.empty()))
+            return false;
     }
+    return true;
+}
 
-//    freadbw = 1440;
-    freadbw = 1920;
-    freadbh = 1080 ;
-//    fread_buf_size = freadbw*freadbh;
-    fread_buf_size = freadbw*freadbh*3;
-    //Allocate Buffer for rawData
-    rawData = (unsigned char *)malloc(fread_buf_size);
-    if (NULL == rawData) {
-        DPRINTF("Rawdata is NULL\n");
+bool compositor::impl::setOutput(const std::string &path) {
+    // Frames already read back go to the file they were read back for.
+    drainReadbacks();
+    mEncoder.stop();
+    if (mOutput.is_open())
+        mOutput.close();
+    if (path.empty())
+        return true;
+    mOutput.clear();
+    mOutput.open(path, std::ios::binary | std::ios::trunc);
+    if (!mOutput) {
+        LOGE("can't open %s for writing", path.c_str());
+        return false;
     }
+    return true;
+}
 
+void compositor::impl::setFrameCallback(const compositor_frame_callback_t &callback) {
+    drainReadbacks();
+    mEncoder.stop();
+    mFrameCallback = callback;
+}
 
+// Runs on the encode thread: queues a frame for pullFrame(), dropping the
+// oldest one when the consumer has fallen behind.
+void compositor::impl::keepForPull(const compositor_frame_t &frame) {
+    std::lock_guard<std::mutex> lock(mPullMutex);
+    if (mPulled.empty())
+        return;
+    if (mPulledCount == mPulled.size()) {
+        mPulled[mPulledHead].buffer.release();
+        mPulledHead = (mPulledHead + 1) % mPulled.size();
+        mPulledCount--;
+    }
+    mPulled[(mPulledHead + mPulledCount) % mPulled.size()] = frame;
+    mPulledCount++;
 }
 
-void _loadShader(JNIEnv *env, jstring jvs, jstring jfs) {
-    jboolean b;
-    if(jvs) {
-        const char *vs = env->GetStringUTFChars(jvs, &b);
-        gVs = vs? strdup(vs) : NULL;
-        env->ReleaseStringUTFChars(jvs, vs);
-    } else
-        gVs = (char *)gVertexShader;
+void compositor::impl::setPullQueue(size_t depth) {
+    std::lock_guard<std::mutex> lock(mPullMutex);
+    mRequestedPullDepth = depth;
+    mPullDepthRequested = true;
+}
 
-    if(jfs) {
-        const char *fs = env->GetStringUTFChars(jfs, &b);
-        gFs = fs? strdup(fs) : NULL;
-        env->ReleaseStringUTFChars(jfs, fs);
-    } else
-        gFs = (char *)gFragmentShader;
+// Runs on the GL thread: resizes the pull queue to the depth last asked for.
+void compositor::impl::applyPullQueue() {
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(mPullMutex);
+        if (!mPullDepthRequested)
+            return;
+        depth = mRequestedPullDepth;
+        mPullDepthRequested = false;
+    }
+    // The encode thread reads mPullDepth unguarded.
+    drainReadbacks();
+    mEncoder.stop();
+    std::lock_guard<std::mutex> lock(mPullMutex);
+    // Frames still queued go back to the pool.
+    mPulled.clear();
+    mPulled.resize(depth);
+    mPulledHead = 0;
+    mPulledCount = 0;
+    mPullDepth = depth;
+}
 
-    initProgram();
+bool compositor::impl::pullFrame(compositor_frame_t &frame) {
+    std::lock_guard<std::mutex> lock(mPullMutex);
+    if (!mPulledCount)
+        return false;
+    frame = std::move(mPulled[mPulledHead]);
+    mPulledHead = (mPulledHead + 1) % mPulled.size();
+    mPulledCount--;
+    return true;
 }
 
-extern "C" {
-JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_init(JNIEnv *env, jobject obj, jobject bmp)
-{
-    _init(env, bmp);
+compositor::impl::~impl() {
+    drainReadbacks();
+    mEncoder.stop();
+    closeStreams();
+    GLuint buffers[] = { mTileBuffer, mQuadBuffer, mInstanceBuffer };
+    glDeleteBuffers(3, buffers);
+    glDeleteProgram(programId);
+    glDeleteProgram(mNv12Program.id);
+    glDeleteProgram(mMipi10Program.id);
+    glDeleteProgram(mYuv10Program.id);
+    glDeleteProgram(mInstancedProgram.id);
+    glDeleteTextures(1, &mCompositeTexture);
+    mComposite.release();
+    mReadback10.release();
+    mPackBuffers.release();
+    mPackPass.release();
+    freeShaderSources();
 }
 
-JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_resize(JNIEnv *env, jobject obj, jint width, jint height)
-{
-    setupGraphics(width, height);
+compositor::compositor()
+    : m_impl(new impl()) {
 }
 
-JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_step(JNIEnv *env, jobject obj)
-{
-    renderFrame();
+compositor::~compositor() {
 }
 
-JNIEXPORT void JNICALL Java_com_android_gl2jni_GL2JNILib_loadShader(JNIEnv *env, jobject obj, jstring vs, jstring fs)
-{
-    _loadShader(env, vs, fs);
+bool compositor::init(const std::string &manifest_path) {
+    return m_impl->init(manifest_path);
+}
+
+bool compositor::init_default() {
+    return m_impl->initDefault();
+}
+
+void compositor::context_lost() {
+    m_impl->contextLost();
+}
+
+bool compositor::load_shader(const char *vertex_source, const char *fragment_source) {
+    return m_impl->loadShaderSources(vertex_source, fragment_source);
+}
+
+bool compositor::resize(int width, int height) {
+    return m_impl->setupGraphics(width, height);
+}
+
+bool compositor::render() {
+    return m_impl->renderFrame();
+}
+
+bool compositor::finished() const {
+    return m_impl->finished();
+}
+
+void compositor::set_paced(bool paced) {
+    m_impl->mPaced = paced;
+}
+
+void compositor::flush() {
+    m_impl->flush();
+}
+
+void compositor::set_frame_callback(const compositor_frame_callback_t &callback) {
+    m_impl->setFrameCallback(callback);
+}
+
+void compositor::set_pull_queue(size_t depth) {
+    m_impl->setPullQueue(depth);
+}
+
+bool compositor::pull_frame(compositor_frame_t &frame) {
+    return m_impl->pullFrame(frame);
+}
+
+bool compositor::set_output(const std::string &path) {
+    return m_impl->setOutput(path);
+}
+
+compositor_stages_t &compositor::stages() {
+    return m_impl->mStages;
 }
-};
\ No newline at end of file
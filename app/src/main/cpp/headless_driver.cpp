@@ -0,0 +1,237 @@
+//--------------------------------------------------------------------------------------
+// File: headless_driver.cpp
+// Desc: Runs the compositor without a window, on a pbuffer context of its own,
+//       as fast as the streams can be read.
+//--------------------------------------------------------------------------------------
+#include "headless_driver.h"
+
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include "log_sink.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#define LOG_TAG    "headless_driver.cpp"
+
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+namespace
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+bool has_extension(const char *extensions, const char *name)
+{
+    const size_t length = std::strlen(name);
+    for (const char *p = extensions; p && (p = std::strstr(p, name)) != NULL; p += length)
+    {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+// The surfaceless platform needs neither X11 nor Wayland; elsewhere, e.g. on
+// Android, the default display is already headless capable.
+EGLDisplay open_display()
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+        {
+            return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+#endif
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// Drivers on the same display; terminating it would pull it from under the others.
+std::mutex g_display_mutex;
+size_t     g_display_users = 0;
+
+void log_stage(const char *name, const stage_timer &timer)
+{
+    DPRINTF1("%s mean:[%lf] max:[%lf]msec", name, timer.mean_ms(), timer.max_ms());
+}
+}
+
+headless_driver::headless_driver()
+    : m_display(EGL_NO_DISPLAY),
+      m_context(EGL_NO_CONTEXT),
+      m_surface(EGL_NO_SURFACE),
+      m_width(0),
+      m_height(0)
+{
+}
+
+headless_driver::~headless_driver()
+{
+    release();
+}
+
+bool headless_driver::create(int width, int height)
+{
+    release();
+
+    {
+        std::lock_guard<std::mutex> lock(g_display_mutex);
+        m_display = open_display();
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, NULL, NULL))
+        {
+            EPRINTF1("Can't initialise an EGL display");
+            m_display = EGL_NO_DISPLAY;
+            return false;
+        }
+        ++g_display_users;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    // OpenGL ES 3 first, as the deep read backs and PBO uploads need it.
+    static const EGLint versions[]        = { 3, 2 };
+    static const EGLint renderable_bits[] = { EGL_OPENGL_ES3_BIT_KHR, EGL_OPENGL_ES2_BIT };
+    for (int v = 0; v < 2 && m_context == EGL_NO_CONTEXT; ++v)
+    {
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, renderable_bits[v],
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint    count = 0;
+        if (!eglChooseConfig(m_display, config_attribs, &config, 1, &count) || count == 0)
+        {
+            continue;
+        }
+        const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, versions[v], EGL_NONE };
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (m_context == EGL_NO_CONTEXT)
+        {
+            continue;
+        }
+        const EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        m_surface = eglCreatePbufferSurface(m_display, config, surface_attribs);
+        if (m_surface == EGL_NO_SURFACE)
+        {
+            eglDestroyContext(m_display, m_context);
+            m_context = EGL_NO_CONTEXT;
+        }
+    }
+    if (m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+    {
+        EPRINTF1("Can't create a %dx%d pbuffer context", width, height);
+        release();
+        return false;
+    }
+    m_width  = width;
+    m_height = height;
+    m_compositor.reset(new compositor());
+    return true;
+}
+
+void headless_driver::release()
+{
+    if (m_display == EGL_NO_DISPLAY)
+    {
+        return;
+    }
+    // The compositor frees its GL objects, so its context must still be current.
+    m_compositor.reset();
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_surface != EGL_NO_SURFACE)
+    {
+        eglDestroySurface(m_display, m_surface);
+    }
+    if (m_context != EGL_NO_CONTEXT)
+    {
+        eglDestroyContext(m_display, m_context);
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_display_mutex);
+        if (--g_display_users == 0)
+        {
+            eglTerminate(m_display);
+        }
+    }
+    m_display = EGL_NO_DISPLAY;
+    m_context = EGL_NO_CONTEXT;
+    m_surface = EGL_NO_SURFACE;
+}
+
+compositor *headless_driver::get_compositor()
+{
+    return m_compositor.get();
+}
+
+bool headless_driver::run(const std::string &manifest_path, const char *vertex_source, const char *fragment_source,
+                          uint64_t max_frames, headless_report_t &report)
+{
+    report.frames     = 0;
+    report.idle_ticks = 0;
+    report.seconds    = 0.0;
+    report.fps        = 0.0;
+    if (!m_compositor)
+    {
+        return false;
+    }
+
+    // Sized first, so the streams start reading at the size their tiles need
+    // instead of being restarted, and losing the frames already read, by a resize.
+    m_compositor->set_paced(false);
+    m_compositor->resize(m_width, m_height);
+    if (!m_compositor->init(manifest_path) || !m_compositor->load_shader(vertex_source, fragment_source))
+    {
+        return false;
+    }
+
+    compositor_stages_t &stages = m_compositor->stages();
+    stages.upload.reset();
+    stages.draw.reset();
+    stages.readback.reset();
+    stages.dropped = 0;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (!m_compositor->finished() && (max_frames == 0 || report.frames < max_frames))
+    {
+        if (m_compositor->render())
+        {
+            ++report.frames;
+        }
+        else
+        {
+            // The readers are behind; let them have the core.
+            ++report.idle_ticks;
+            std::this_thread::yield();
+        }
+    }
+    m_compositor->flush();
+    glFinish();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report.fps     = report.seconds > 0.0 ? report.frames / report.seconds : 0.0;
+    report.stages  = stages;
+
+    DPRINTF1("headless: %llu frames in %.3lf s, %.1lf fps, %llu idle ticks", (unsigned long long) report.frames,
+             report.seconds, report.fps, (unsigned long long) report.idle_ticks);
+    log_stage("upload", stages.upload);
+    log_stage("draw", stages.draw);
+    log_stage("readback", stages.readback);
+    log_stage("encode", stages.encode);
+    if (stages.dropped)
+    {
+        EPRINTF1("headless: dropped %llu frames", (unsigned long long) stages.dropped);
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: headless_driver.h
+// Desc: Runs the compositor without a window, on a pbuffer context of its own,
+//       as fast as the streams can be read.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_HEADLESS_DRIVER_H
+#define ANDROID_SHADER_DEMO_JNI_HEADLESS_DRIVER_H
+
+#include <EGL/egl.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "compositor.h"
+
+/**
+ * \brief Outcome of a headless run: how many frames were composited, i.e.
+ *        ticks in which at least one stream advanced, and how long it took.
+ */
+struct headless_report_t
+{
+    uint64_t            frames;
+    uint64_t            idle_ticks;
+    double              seconds;
+    double              fps;
+    compositor_stages_t stages;
+};
+
+/**
+ * \brief Owns an EGL context and pbuffer surface and a compositor on them, and
+ *        drives it from the calling thread, unpaced by vsync.
+ *
+ * The context is OpenGL ES 3 where available and OpenGL ES 2 otherwise. On
+ * Mesa the surfaceless platform is used, so no display server is needed.
+ * Drivers share the EGL display but nothing else, so several can run in
+ * parallel, each on its own thread.
+ */
+class headless_driver {
+public:
+    headless_driver();
+    ~headless_driver();
+
+    /**
+     * \brief Creates the context with a width x height pbuffer as its default
+     *        framebuffer, makes it current on the calling thread, and creates
+     *        the compositor on it. All other calls must come from that thread.
+     *
+     * @param width
+     * @param height
+     * @return false if EGL offers no pbuffer capable OpenGL ES config
+     */
+    bool          create(int width, int height);
+
+    /**
+     * \brief Destroys the compositor, then the context and surface. The
+     *        display is terminated with the last driver using it.
+     */
+    void          release();
+
+    /**
+     * \brief Gets the compositor, e.g. to set its output before run().
+     * @return NULL until create() succeeded
+     */
+    compositor   *get_compositor();
+
+    /**
+     * \brief Composites the streams of a manifest until all of them ended, or
+     *        max_frames were composited, reading containers flat out.
+     *
+     * @param manifest_path
+     * @param vertex_source - NULL for the default pass-through shader
+     * @param fragment_source - NULL for the default pass-through shader
+     * @param max_frames - 0 for no limit
+     * @param report [out]
+     * @return false if no context was created or no stream could be opened
+     */
+    bool          run(const std::string &manifest_path, const char *vertex_source, const char *fragment_source,
+                      uint64_t max_frames, headless_report_t &report);
+
+private:
+    // Data members
+    EGLDisplay    m_display;
+    EGLContext    m_context;
+    EGLSurface    m_surface;
+    int           m_width;
+    int           m_height;
+    std::unique_ptr<compositor> m_compositor;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_HEADLESS_DRIVER_H
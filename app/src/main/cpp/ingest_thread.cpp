@@ -0,0 +1,144 @@
+//--------------------------------------------------------------------------------------
+// File: ingest_thread.cpp
+// Desc: Producer thread that reads frames ahead of the GL thread into a frame_ring.
+//--------------------------------------------------------------------------------------
+#include "ingest_thread.h"
+#include "pixel_convert.h"
+#include "log_sink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define LOG_TAG    "ingest_thread.cpp"
+
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+
+// Frames between two reports of the copy throughput.
+static const uint64_t COPY_STATS_INTERVAL = 120;
+
+ingest_thread::ingest_thread()
+    : m_source(NULL),
+      m_stop(false),
+      m_pace_fps(0.0),
+      m_swap_red_blue(false),
+      m_downscale(0)
+{
+}
+
+ingest_thread::~ingest_thread()
+{
+    stop();
+}
+
+bool ingest_thread::start(frame_source *source, size_t slot_count, ring_policy_t policy, double pace_fps,
+                          unsigned char *const *slot_data)
+{
+    if (m_thread.joinable() || !source || source->frame_count() == 0 || slot_count == 0)
+    {
+        return false;
+    }
+
+    m_source   = source;
+    m_pace_fps = pace_fps;
+    m_ring.reset(new frame_ring(slot_count, upload_frame_bytes(downscaled_format(source->format(), m_downscale)),
+                                policy, slot_data));
+    m_copy.reset();
+    m_stop     = false;
+    m_thread   = std::thread(&ingest_thread::run, this);
+    return true;
+}
+
+void ingest_thread::stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    m_stop = true;
+    m_ring->close();
+    m_thread.join();
+}
+
+void ingest_thread::run()
+{
+    typedef std::chrono::steady_clock clock;
+    const clock::duration frame_period = m_pace_fps > 0.0
+            ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / m_pace_fps))
+            : clock::duration::zero();
+    clock::time_point deadline = clock::now();
+
+    while (!m_stop)
+    {
+        const size_t         index = m_source->position();
+        const unsigned char *frame = m_source->next_frame();
+        if (!frame)
+        {
+            DPRINTF1("end of stream after %zu frames", index);
+            break;
+        }
+
+        frame_slot_t *slot = m_ring->acquire_write();
+        if (!slot)
+        {
+            break;
+        }
+        m_copy.begin();
+        downscale_upload_frame(slot->data, frame, m_source->format(), m_downscale, m_swap_red_blue, m_scratch);
+        m_copy.end();
+        if (m_copy.count() == COPY_STATS_INTERVAL)
+        {
+            // Bytes read plus bytes written, per second.
+            const double bytes = static_cast<double>(frame_bytes(m_source->format()) + slot->capacity);
+            DPRINTF1("ingest copy mean:[%lf] max:[%lf]msec, %.2lf GB/s", m_copy.mean_ms(), m_copy.max_ms(),
+                     bytes / (m_copy.mean_ms() * 1e6));
+            m_copy.reset();
+        }
+        slot->bytes       = slot->capacity;
+        slot->frame_index = index;
+        m_ring->commit_write(slot);
+
+        if (frame_period != clock::duration::zero())
+        {
+            // Don't burst to catch up after the ring made us wait.
+            deadline = std::max(deadline + frame_period, clock::now());
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+    m_ring->close();
+}
+
+frame_slot_t *ingest_thread::try_pop()
+{
+    return m_ring ? m_ring->try_acquire_read() : NULL;
+}
+
+void ingest_thread::release(frame_slot_t *slot)
+{
+    if (m_ring && slot)
+    {
+        m_ring->release_read(slot);
+    }
+}
+
+bool ingest_thread::finished() const
+{
+    return m_ring && m_ring->drained();
+}
+
+void ingest_thread::set_swap_red_blue(bool swap)
+{
+    m_swap_red_blue = swap;
+}
+
+void ingest_thread::set_downscale(unsigned levels)
+{
+    m_downscale = levels;
+}
+
+ring_stats_t ingest_thread::stats() const
+{
+    ring_stats_t stats;
+    std::memset(&stats, 0, sizeof(stats));
+    return m_ring ? m_ring->stats() : stats;
+}
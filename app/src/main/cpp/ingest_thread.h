@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// File: ingest_thread.h
+// Desc: Producer thread that reads frames ahead of the GL thread into a frame_ring.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_INGEST_THREAD_H
+#define ANDROID_SHADER_DEMO_JNI_INGEST_THREAD_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "frame_source.h"
+#include "stage_timer.h"
+
+/**
+ * \brief Reads frames from a frame_source on its own thread into a bounded
+ *        ring of preallocated buffers.
+ *
+ * The consumer, normally the GL thread, only ever pops frames that are already
+ * in memory, so I/O stalls in the source never stretch a render tick.
+ */
+class ingest_thread {
+public:
+    ingest_thread();
+
+    /**
+     * \brief Stops the thread, if running.
+     */
+    ~ingest_thread();
+
+    /**
+     * \brief Starts reading from the source's current position.
+     *
+     * The source must outlive the thread. If pace_fps is positive the producer
+     * holds that frame rate, otherwise it reads as fast as the ring allows.
+     * Frames are stored in their upload layout (see downscale_upload_frame()),
+     * in slot_data when given, e.g. mapped pixel buffer objects, otherwise in
+     * buffers the ring allocates.
+     *
+     * @param source
+     * @param slot_count - Number of frames buffered ahead of the consumer
+     * @param policy - What to do when the consumer falls behind
+     * @param pace_fps
+     * @param slot_data - slot_count buffers of upload_frame_bytes() of the
+     *                    downscaled format each, or NULL
+     * @return false if already running or the source is empty
+     */
+    bool          start(frame_source *source, size_t slot_count, ring_policy_t policy, double pace_fps,
+                        unsigned char *const *slot_data = NULL);
+
+    /**
+     * \brief Stops and joins the producer thread. Frames still held by the
+     *        consumer must not be used afterwards.
+     */
+    void          stop();
+
+    /**
+     * \brief Takes the oldest ready frame without waiting.
+     * @return the frame, or NULL on underrun or at end of stream
+     */
+    frame_slot_t *try_pop();
+
+    /**
+     * \brief Hands a frame from try_pop() back to the producer.
+     * @param slot
+     */
+    void          release(frame_slot_t *slot);
+
+    /**
+     * \brief Returns true once the source is exhausted and every frame was popped.
+     * @return
+     */
+    bool          finished() const;
+
+    ring_stats_t  stats() const;
+
+    /**
+     * \brief Sets whether RGB24 frames are stored as BGR and need their red and
+     *        blue swapped on the way into the ring. Call before start().
+     * @param swap
+     */
+    void          set_swap_red_blue(bool swap);
+
+    /**
+     * \brief Sets how many times frames are halved in each direction before
+     *        they go into the ring. Call before start().
+     * @param levels - At most max_downscale_levels() of the source format
+     */
+    void          set_downscale(unsigned levels);
+
+private:
+    void          run();
+
+    // Data members
+    frame_source               *m_source;
+    std::unique_ptr<frame_ring> m_ring;
+    std::thread                 m_thread;
+    std::atomic<bool>           m_stop;
+    double                      m_pace_fps;
+    bool                        m_swap_red_blue;
+    unsigned                    m_downscale;
+    // Copy into the ring and its scratch rows, owned by the producer thread.
+    stage_timer                 m_copy;
+    std::vector<unsigned char>  m_scratch;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_INGEST_THREAD_H
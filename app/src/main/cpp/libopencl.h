@@ -1,9 +1,8 @@
 #ifndef LIBOPENCL_STUB_H
 #define LIBOPENCL_STUB_H
-#include <android/log.h>
+#include "log_sink.h"
 #include <stdlib.h>
 #include <math.h>
-#include <jni.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -11,7 +10,7 @@
 #include <sys/time.h>
 #define LOG_TAG    "libopencl.h"
 
-#define DPRINTF(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define DPRINTF(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
 //#include <utility>
 //#include <iostream>
 //#include <fstream>
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// File: log_sink.cpp
+// Desc: Where the engine's log messages go: logcat on Android, stderr elsewhere,
+//       or a sink the embedding application installs.
+//--------------------------------------------------------------------------------------
+#include "log_sink.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+
+namespace
+{
+// Long enough for every message the engine writes; longer ones are truncated.
+const size_t MAX_MESSAGE_LENGTH = 1024;
+
+void default_sink(log_level_t level, const char *tag, const char *message, void *context)
+{
+#ifdef __ANDROID__
+    static const int priorities[] = { ANDROID_LOG_DEBUG, ANDROID_LOG_INFO, ANDROID_LOG_WARN, ANDROID_LOG_ERROR };
+    __android_log_write(priorities[level], tag, message);
+#else
+    static const char levels[] = { 'D', 'I', 'W', 'E' };
+    std::fprintf(stderr, "%c/%s: %s\n", levels[level], tag, message);
+#endif
+}
+
+std::atomic<log_sink_t>  g_sink(default_sink);
+std::atomic<void *>      g_context(NULL);
+std::atomic<int>         g_level(LOG_LEVEL_DEBUG);
+}
+
+void set_log_sink(log_sink_t sink, void *context)
+{
+    g_context = context;
+    g_sink    = sink ? sink : default_sink;
+}
+
+void set_log_level(log_level_t level)
+{
+    g_level = level;
+}
+
+void log_print(log_level_t level, const char *tag, const char *format, ...)
+{
+    if (level < g_level)
+    {
+        return;
+    }
+    char    message[MAX_MESSAGE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    const int length = std::vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    // Some callers end their messages with a newline, as logcat doesn't care.
+    if (length > 0 && static_cast<size_t>(length) < sizeof(message) && message[length - 1] == '\n')
+    {
+        message[length - 1] = '\0';
+    }
+    g_sink.load()(level, tag, message, g_context.load());
+}
@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------
+// File: log_sink.h
+// Desc: Where the engine's log messages go: logcat on Android, stderr elsewhere,
+//       or a sink the embedding application installs.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_LOG_SINK_H
+#define ANDROID_SHADER_DEMO_JNI_LOG_SINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR
+} log_level_t;
+
+/**
+ * \brief Receives one formatted message, without a trailing newline. May be
+ *        called from any of the engine's threads at once.
+ */
+typedef void (*log_sink_t)(log_level_t level, const char *tag, const char *message, void *context);
+
+/**
+ * \brief Replaces the sink messages go to. Install it before starting the
+ *        engine, as threads already logging may still see the old one.
+ *
+ * @param sink - NULL for the default, logcat on Android and stderr elsewhere
+ * @param context - Passed to every call of sink
+ */
+void set_log_sink(log_sink_t sink, void *context);
+
+/**
+ * \brief Drops messages below a level before they are formatted.
+ * @param level - LOG_LEVEL_DEBUG by default
+ */
+void set_log_level(log_level_t level);
+
+/**
+ * \brief Formats a message printf style and hands it to the sink.
+ *
+ * @param level
+ * @param tag - Where the message comes from, usually the file's LOG_TAG
+ * @param format
+ */
+void log_print(log_level_t level, const char *tag, const char *format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANDROID_SHADER_DEMO_JNI_LOG_SINK_H
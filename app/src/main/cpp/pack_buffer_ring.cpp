@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// File: pack_buffer_ring.cpp
+// Desc: Ring of pixel pack buffers for asynchronous read backs.
+//--------------------------------------------------------------------------------------
+#include "pack_buffer_ring.h"
+#include "log_sink.h"
+
+#define LOG_TAG    "pack_buffer_ring.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+pack_buffer_ring::pack_buffer_ring()
+    : m_buffer_bytes(0)
+{
+}
+
+bool pack_buffer_ring::create(size_t buffer_count, size_t buffer_bytes)
+{
+    release();
+
+    m_buffer_bytes = buffer_bytes;
+    m_buffers.resize(buffer_count);
+    m_fences.assign(buffer_count, (GLsync) NULL);
+    m_mapped.assign(buffer_count, false);
+    m_fenced_at.resize(buffer_count);
+    glGenBuffers(buffer_count, m_buffers.data());
+    for (size_t i = 0; i < buffer_count; ++i)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, buffer_bytes, NULL, GL_STREAM_READ);
+        GLint size = 0;
+        glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &size);
+        if (static_cast<size_t>(size) != buffer_bytes)
+        {
+            EPRINTF1("Can't allocate a %zu byte pack buffer", buffer_bytes);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            release();
+            return false;
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void pack_buffer_ring::release()
+{
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+    {
+        if (m_fences[i])
+        {
+            glDeleteSync(m_fences[i]);
+        }
+        if (m_mapped[i])
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!m_buffers.empty())
+    {
+        glDeleteBuffers(m_buffers.size(), m_buffers.data());
+    }
+    abandon();
+}
+
+void pack_buffer_ring::abandon()
+{
+    m_buffers.clear();
+    m_fences.clear();
+    m_mapped.clear();
+    m_fenced_at.clear();
+    m_buffer_bytes = 0;
+}
+
+size_t pack_buffer_ring::count() const
+{
+    return m_buffers.size();
+}
+
+size_t pack_buffer_ring::buffer_bytes() const
+{
+    return m_buffer_bytes;
+}
+
+void pack_buffer_ring::bind_for_read(size_t index)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[index]);
+}
+
+void pack_buffer_ring::fence(size_t index)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (m_fences[index])
+    {
+        glDeleteSync(m_fences[index]);
+    }
+    m_fences[index]    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_fenced_at[index] = std::chrono::steady_clock::now();
+    // Let the GPU start on the read now rather than whenever the driver next
+    // flushes, so it is done by the time the buffer is polled.
+    glFlush();
+}
+
+const unsigned char *pack_buffer_ring::try_map(size_t index, size_t offset, size_t bytes, bool wait)
+{
+    if (m_fences[index])
+    {
+        const GLenum status = glClientWaitSync(m_fences[index], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                               wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            return NULL;
+        }
+        glDeleteSync(m_fences[index]);
+        m_fences[index] = NULL;
+        m_in_flight.add(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - m_fenced_at[index]).count());
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[index]);
+    const unsigned char *mapping = static_cast<const unsigned char *>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset, bytes, GL_MAP_READ_BIT));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_mapped[index] = mapping != NULL;
+    return mapping;
+}
+
+void pack_buffer_ring::unmap(size_t index)
+{
+    if (!m_mapped[index])
+    {
+        return;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[index]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_mapped[index] = false;
+}
+
+stage_timer &pack_buffer_ring::in_flight()
+{
+    return m_in_flight;
+}
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: pack_buffer_ring.h
+// Desc: Ring of pixel pack buffers for asynchronous read backs.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_PACK_BUFFER_RING_H
+#define ANDROID_SHADER_DEMO_JNI_PACK_BUFFER_RING_H
+
+#include <GLES3/gl3.h>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "stage_timer.h"
+
+/**
+ * \brief GL_PIXEL_PACK_BUFFER objects that glReadPixels writes into while the
+ *        GL thread moves on, each mapped only once its fence has signalled.
+ *
+ * Every buffer cycles through: free -> bound for a read -> fenced -> mapped
+ * once the fence has signalled -> free again when unmapped. All calls must be
+ * made on the thread owning the context. Needs OpenGL ES 3.
+ */
+class pack_buffer_ring {
+public:
+    pack_buffer_ring();
+
+    /**
+     * \brief Creates buffer_count buffers of buffer_bytes each.
+     *
+     * @param buffer_count
+     * @param buffer_bytes
+     * @return false if a buffer can't be allocated
+     */
+    bool                 create(size_t buffer_count, size_t buffer_bytes);
+
+    /**
+     * \brief Unmaps and deletes every buffer and fence.
+     */
+    void                 release();
+
+    /**
+     * \brief Forgets every buffer and fence without unmapping or deleting
+     *        them, once the context they were created on is gone. Needs no
+     *        context.
+     */
+    void                 abandon();
+
+    size_t               count() const;
+    size_t               buffer_bytes() const;
+
+    /**
+     * \brief Binds a buffer to GL_PIXEL_PACK_BUFFER, so glReadPixels writes
+     *        into it at byte offsets instead of client pointers.
+     *
+     * @param index
+     */
+    void                 bind_for_read(size_t index);
+
+    /**
+     * \brief Unbinds the buffer after its reads were issued and fences them.
+     * @param index
+     */
+    void                 fence(size_t index);
+
+    /**
+     * \brief Maps part of a fenced buffer for reading if the GPU has written it.
+     *
+     * @param index
+     * @param offset
+     * @param bytes
+     * @param wait - Block until the fence signals instead of polling it
+     * @return the mapping, or NULL while the read is still in flight or if
+     *         the buffer can't be mapped
+     */
+    const unsigned char *try_map(size_t index, size_t offset, size_t bytes, bool wait);
+
+    /**
+     * \brief Unmaps a buffer from try_map(), making it free for the next read.
+     * @param index
+     */
+    void                 unmap(size_t index);
+
+    /**
+     * \brief Time from fence() until try_map() found the read complete, i.e.
+     *        how long the read back overlapped with other work.
+     * @return
+     */
+    stage_timer         &in_flight();
+
+private:
+    // Data members
+    std::vector<GLuint>  m_buffers;
+    std::vector<GLsync>  m_fences;
+    std::vector<bool>    m_mapped;
+    std::vector<std::chrono::steady_clock::time_point> m_fenced_at;
+    size_t               m_buffer_bytes;
+    stage_timer          m_in_flight;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_PACK_BUFFER_RING_H
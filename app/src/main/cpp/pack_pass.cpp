@@ -0,0 +1,260 @@
+//--------------------------------------------------------------------------------------
+// File: pack_pass.cpp
+// Desc: GPU passes that pack a composite into a compact layout before read back.
+//--------------------------------------------------------------------------------------
+#include "pack_pass.h"
+#include "log_sink.h"
+#include "shader_program.h"
+
+#include <cstddef>
+
+#define LOG_TAG    "pack_pass.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+static const char *PACK_VERTEX_SHADER =
+    "attribute vec2 aPosition;\n"
+    "void main() {\n"
+    "   gl_Position = vec4(aPosition, 0.0, 1.0);\n"
+    "}";
+
+// Target texel i of a row takes source pixels 4i..4i+3. Pixel coordinates
+// run past 1024, so they need more than mediump where it is available.
+static const char *PACK_LUMA_FRAGMENT_SHADER =
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 sourceSize;\n"
+    "void main() {\n"
+    "   float x = 4.0 * gl_FragCoord.x - 1.5;\n"
+    "   float v = gl_FragCoord.y / sourceSize.y;\n"
+    "   gl_FragColor = vec4(texture2D(source, vec2(x / sourceSize.x, v)).r,\n"
+    "                       texture2D(source, vec2((x + 1.0) / sourceSize.x, v)).r,\n"
+    "                       texture2D(source, vec2((x + 2.0) / sourceSize.x, v)).r,\n"
+    "                       texture2D(source, vec2((x + 3.0) / sourceSize.x, v)).r);\n"
+    "}";
+
+// The target holds the Y plane in its first sourceSize.y rows and the UV plane
+// in the rows above, so reading it back bottom row first yields NV12. Texel i
+// of a Y row takes source pixels 4i..4i+3; of a UV row, the U and V of pixels
+// 4i..4i+1 and 4i+2..4i+3 over two source rows. Source rows are counted from
+// the top, and flip reads a texture stored bottom row first the right way up.
+static const char *PACK_NV12_FRAGMENT_SHADER =
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 sourceSize;\n"
+    "uniform float flip;\n"
+    "vec3 rgb(float x, float y) {\n"
+    "   return texture2D(source, vec2(x, mix(y, sourceSize.y - y, flip)) / sourceSize).rgb;\n"
+    "}\n"
+    // BT.601, limited range: the inverse of the matrix YUV streams are drawn with.
+    "float luma(vec3 c) {\n"
+    "   return dot(c, vec3(0.256788, 0.504129, 0.097906)) + 0.062745;\n"
+    "}\n"
+    "vec2 chroma(vec3 c) {\n"
+    "   return vec2(dot(c, vec3(-0.148223, -0.290993, 0.439216)),\n"
+    "               dot(c, vec3(0.439216, -0.367788, -0.071427))) + 0.501961;\n"
+    "}\n"
+    "void main() {\n"
+    "   float x = 4.0 * gl_FragCoord.x - 1.5;\n"
+    "   float row = gl_FragCoord.y - 0.5;\n"
+    "   if (row < sourceSize.y) {\n"
+    "       float y = row + 0.5;\n"
+    "       gl_FragColor = vec4(luma(rgb(x, y)), luma(rgb(x + 1.0, y)),\n"
+    "                           luma(rgb(x + 2.0, y)), luma(rgb(x + 3.0, y)));\n"
+    "   } else {\n"
+    "       float y = 2.0 * (row - sourceSize.y) + 0.5;\n"
+    "       vec3 left = rgb(x, y) + rgb(x + 1.0, y) + rgb(x, y + 1.0) + rgb(x + 1.0, y + 1.0);\n"
+    "       vec3 right = rgb(x + 2.0, y) + rgb(x + 3.0, y) + rgb(x + 2.0, y + 1.0) + rgb(x + 3.0, y + 1.0);\n"
+    "       gl_FragColor = vec4(chroma(0.25 * left), chroma(0.25 * right));\n"
+    "   }\n"
+    "}";
+
+static const GLfloat FULLSCREEN_QUAD[] = {
+    -1.0f, -1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f
+};
+
+pack_pass::pack_pass()
+    : m_program(0),
+      m_position(-1),
+      m_source(-1),
+      m_source_size(-1),
+      m_nv12_program(0),
+      m_nv12_position(-1),
+      m_nv12_source(-1),
+      m_nv12_source_size(-1),
+      m_nv12_flip(-1),
+      m_framebuffer(0),
+      m_target(0),
+      m_target_width(0),
+      m_target_height(0)
+{
+}
+
+bool pack_pass::init()
+{
+    release();
+    m_program = build_program(PACK_VERTEX_SHADER, PACK_LUMA_FRAGMENT_SHADER);
+    if (!m_program)
+    {
+        return false;
+    }
+    m_position    = glGetAttribLocation(m_program, "aPosition");
+    m_source      = glGetUniformLocation(m_program, "source");
+    m_source_size = glGetUniformLocation(m_program, "sourceSize");
+
+    m_nv12_program = build_program(PACK_VERTEX_SHADER, PACK_NV12_FRAGMENT_SHADER);
+    if (!m_nv12_program)
+    {
+        return false;
+    }
+    m_nv12_position    = glGetAttribLocation(m_nv12_program, "aPosition");
+    m_nv12_source      = glGetUniformLocation(m_nv12_program, "source");
+    m_nv12_source_size = glGetUniformLocation(m_nv12_program, "sourceSize");
+    m_nv12_flip        = glGetUniformLocation(m_nv12_program, "flip");
+    return true;
+}
+
+void pack_pass::release()
+{
+    if (m_program)
+    {
+        glDeleteProgram(m_program);
+    }
+    if (m_nv12_program)
+    {
+        glDeleteProgram(m_nv12_program);
+    }
+    if (m_framebuffer)
+    {
+        glDeleteFramebuffers(1, &m_framebuffer);
+    }
+    if (m_target)
+    {
+        glDeleteTextures(1, &m_target);
+    }
+    abandon();
+}
+
+void pack_pass::abandon()
+{
+    m_program       = 0;
+    m_nv12_program  = 0;
+    m_framebuffer   = 0;
+    m_target        = 0;
+    m_target_width  = 0;
+    m_target_height = 0;
+}
+
+bool pack_pass::ensure_target(uint32_t width, uint32_t height)
+{
+    if (m_target && m_target_width == width && m_target_height == height)
+    {
+        return true;
+    }
+
+    if (!m_target)
+    {
+        glGenTextures(1, &m_target);
+        glGenFramebuffers(1, &m_framebuffer);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_target);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_target, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        EPRINTF1("pack target of %ux%u is not renderable", width, height);
+        m_target_width  = 0;
+        m_target_height = 0;
+        return false;
+    }
+    m_target_width  = width;
+    m_target_height = height;
+    return true;
+}
+
+bool pack_pass::read_luma(GLuint src_texture, uint32_t width, uint32_t height, unsigned char *dst)
+{
+    if (!m_program || width % 4 != 0)
+    {
+        return false;
+    }
+
+    GLint framebuffer;
+    GLint viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    bool ok = ensure_target(width / 4, height);
+    if (ok)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glViewport(0, 0, width / 4, height);
+        glUseProgram(m_program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, src_texture);
+        glUniform1i(m_source, 0);
+        glUniform2f(m_source_size, (GLfloat) width, (GLfloat) height);
+        glVertexAttribPointer(m_position, 2, GL_FLOAT, GL_FALSE, 0, FULLSCREEN_QUAD);
+        glEnableVertexAttribArray(m_position);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width / 4, height, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    return ok;
+}
+
+bool pack_pass::read_nv12(GLuint src_texture, uint32_t width, uint32_t height, bool src_top_down,
+                          unsigned char *dst)
+{
+    if (!m_nv12_program || width % 4 != 0 || height % 2 != 0)
+    {
+        return false;
+    }
+
+    GLint framebuffer;
+    GLint viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    const uint32_t rows = height + height / 2;
+    bool ok = ensure_target(width / 4, rows);
+    if (ok)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glViewport(0, 0, width / 4, rows);
+        glUseProgram(m_nv12_program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, src_texture);
+        glUniform1i(m_nv12_source, 0);
+        glUniform2f(m_nv12_source_size, (GLfloat) width, (GLfloat) height);
+        glUniform1f(m_nv12_flip, src_top_down ? 0.0f : 1.0f);
+        glVertexAttribPointer(m_nv12_position, 2, GL_FLOAT, GL_FALSE, 0, FULLSCREEN_QUAD);
+        glEnableVertexAttribArray(m_nv12_position);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width / 4, rows, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    return ok;
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// File: pack_pass.h
+// Desc: GPU passes that pack a composite into a compact layout before read back.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_PACK_PASS_H
+#define ANDROID_SHADER_DEMO_JNI_PACK_PASS_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+
+/**
+ * \brief Packs single-channel images four pixels to an RGBA texel so that
+ *        glReadPixels, which only guarantees RGBA in GLES2, moves one byte
+ *        per pixel instead of four, and RGB images into NV12 the same way,
+ *        at one and a half bytes per pixel.
+ *
+ * All methods need the GL context the pass was initialised on to be current.
+ */
+class pack_pass {
+public:
+    pack_pass();
+
+    /**
+     * \brief Compiles the pack programs.
+     * @return false if a program can't be built
+     */
+    bool          init();
+
+    /**
+     * \brief Frees the program, framebuffer and target texture.
+     */
+    void          release();
+
+    /**
+     * \brief Forgets the program, framebuffer and target texture without
+     *        deleting them, once the context they were created on is gone.
+     *        Needs no context.
+     */
+    void          abandon();
+
+    /**
+     * \brief Packs the red channel of a texture and reads it back as 8-bit rows.
+     *
+     * The framebuffer binding and viewport in effect are restored afterwards.
+     *
+     * @param src_texture - Texture of width x height pixels
+     * @param width - Must be a multiple of 4
+     * @param height
+     * @param dst [out] - Receives width * height bytes, bottom row first; an
+     *                    offset while a pixel pack buffer is bound
+     * @return false if the width is not a multiple of 4 or the target can't be created
+     */
+    bool          read_luma(GLuint src_texture, uint32_t width, uint32_t height, unsigned char *dst);
+
+    /**
+     * \brief Converts an RGB texture to BT.601 limited range NV12 and reads it
+     *        back: a Y plane, then a half-height plane of interleaved U and V
+     *        averaged over 2x2 pixels, both top row first.
+     *
+     * The framebuffer binding and viewport in effect are restored afterwards.
+     *
+     * @param src_texture - Texture of width x height pixels
+     * @param width - Must be a multiple of 4
+     * @param height - Must be even
+     * @param src_top_down - The texture holds its top row first rather than
+     *                       bottom row first, as GL renders it
+     * @param dst [out] - Receives width * height * 3 / 2 bytes; an offset
+     *                    while a pixel pack buffer is bound
+     * @return false if the size doesn't suit NV12 or the target can't be created
+     */
+    bool          read_nv12(GLuint src_texture, uint32_t width, uint32_t height, bool src_top_down,
+                            unsigned char *dst);
+
+private:
+    bool          ensure_target(uint32_t width, uint32_t height);
+
+    // Data members
+    GLuint        m_program;
+    GLint         m_position;
+    GLint         m_source;
+    GLint         m_source_size;
+    GLuint        m_nv12_program;
+    GLint         m_nv12_position;
+    GLint         m_nv12_source;
+    GLint         m_nv12_source_size;
+    GLint         m_nv12_flip;
+    GLuint        m_framebuffer;
+    GLuint        m_target;
+    uint32_t      m_target_width;
+    uint32_t      m_target_height;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_PACK_PASS_H
@@ -0,0 +1,325 @@
+//--------------------------------------------------------------------------------------
+// File: pixel_convert.cpp
+// Desc: Converts ingested frames into the layout they are uploaded in.
+//--------------------------------------------------------------------------------------
+#include "pixel_convert.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_CONVERT_NEON 1
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PIXEL_CONVERT_SSSE3 1
+#define PIXEL_CONVERT_SSE2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_CONVERT_SSE2 1
+#endif
+
+namespace
+{
+// Bytes of one pixel of the given plane as stored by copy_upload_frame().
+size_t upload_pixel_bytes(pixel_format_t pixel_format, bool chroma)
+{
+    if (pixel_format == PIXEL_FORMAT_RGB24)
+    {
+        return 4;
+    }
+    return chroma ? 2 : 1;
+}
+
+#if PIXEL_CONVERT_SSE2
+// Splits the pixels of a and b, in order, into the even and the odd ones.
+void deinterleave(__m128i a, __m128i b, size_t bytes_per_pixel, __m128i &even, __m128i &odd)
+{
+    if (bytes_per_pixel == 1)
+    {
+        const __m128i low = _mm_set1_epi16(0x00FF);
+        even = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+        odd  = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    }
+    else if (bytes_per_pixel == 2)
+    {
+        // Gather the even 16-bit pixels into the low half of each vector.
+        a = _mm_shufflelo_epi16(_mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shufflelo_epi16(_mm_shufflehi_epi16(b, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        even = _mm_unpacklo_epi64(a, b);
+        odd  = _mm_unpackhi_epi64(a, b);
+    }
+    else
+    {
+        even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+        odd  = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+}
+#endif
+
+// Halves a plane of out_height rows; dst may alias src.
+void halve_plane(unsigned char *dst, const unsigned char *src, size_t src_stride, uint32_t out_width,
+                 uint32_t out_height, size_t bytes_per_pixel)
+{
+    const size_t dst_stride = static_cast<size_t>(out_width) * bytes_per_pixel;
+    for (uint32_t y = 0; y < out_height; ++y)
+    {
+        const unsigned char *row0 = src + 2 * static_cast<size_t>(y) * src_stride;
+        halve_rows(dst + y * dst_stride, row0, row0 + src_stride, out_width, bytes_per_pixel);
+    }
+}
+
+// Halves a packed frame in its upload layout; dst may alias src. The NV12
+// chroma plane moves down to follow the shrinking luma plane.
+void halve_frame(unsigned char *dst, const unsigned char *src, uint32_t width, uint32_t height,
+                 size_t bytes_per_pixel, bool nv12)
+{
+    halve_plane(dst, src, width * bytes_per_pixel, width / 2, height / 2, bytes_per_pixel);
+    if (nv12)
+    {
+        halve_plane(dst + static_cast<size_t>(width / 2) * (height / 2), src + static_cast<size_t>(width) * height,
+                    width, width / 4, height / 4, 2);
+    }
+}
+}
+
+void expand_rgb_to_rgba(unsigned char *dst, const unsigned char *src, size_t pixels, bool swap_red_blue)
+{
+    size_t i = 0;
+#if PIXEL_CONVERT_NEON
+    // De-interleave 16 pixels into planes and interleave them again with alpha.
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+        uint8x16x4_t       rgba;
+        rgba.val[0] = swap_red_blue ? rgb.val[2] : rgb.val[0];
+        rgba.val[1] = rgb.val[1];
+        rgba.val[2] = swap_red_blue ? rgb.val[0] : rgb.val[2];
+        rgba.val[3] = vdupq_n_u8(0xFF);
+        vst4q_u8(dst + i * 4, rgba);
+    }
+#elif PIXEL_CONVERT_SSSE3
+    // Each shuffle spreads 4 pixels over 16 bytes, leaving zeros where alpha
+    // goes. The last 4 of every 16 pixels are loaded from 4 bytes earlier so
+    // no load reaches past the source.
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i rgb_first = swap_red_blue
+            ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+            : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i rgb_last = swap_red_blue
+            ? _mm_setr_epi8(6, 5, 4, -1, 9, 8, 7, -1, 12, 11, 10, -1, 15, 14, 13, -1)
+            : _mm_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const unsigned char *s = src + i * 3;
+        __m128i             *d = reinterpret_cast<__m128i *>(dst + i * 4);
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 12));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 24));
+        const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 32));
+        _mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(a, rgb_first), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(b, rgb_first), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(c, rgb_first), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(e, rgb_last), alpha));
+    }
+#endif
+    expand_rgb_to_rgba_scalar(dst + i * 4, src + i * 3, pixels - i, swap_red_blue);
+}
+
+void expand_rgb_to_rgba_scalar(unsigned char *dst, const unsigned char *src, size_t pixels, bool swap_red_blue)
+{
+    const size_t red  = swap_red_blue ? 2 : 0;
+    const size_t blue = 2 - red;
+    for (size_t i = 0; i < pixels; ++i)
+    {
+        dst[i * 4 + 0] = src[i * 3 + red];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + blue];
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
+
+void halve_rows(unsigned char *dst, const unsigned char *row0, const unsigned char *row1, size_t out_pixels,
+                size_t bytes_per_pixel)
+{
+    const size_t out_bytes = out_pixels * bytes_per_pixel;
+    size_t       i         = 0;
+#if PIXEL_CONVERT_NEON
+    // Rounding halving adds: first down each column, then across pixel pairs.
+    for (; i + 16 <= out_bytes; i += 16)
+    {
+        uint8x16_t even, odd;
+        if (bytes_per_pixel == 1)
+        {
+            const uint8x16x2_t top = vld2q_u8(row0 + i * 2), bottom = vld2q_u8(row1 + i * 2);
+            even = vrhaddq_u8(top.val[0], bottom.val[0]);
+            odd  = vrhaddq_u8(top.val[1], bottom.val[1]);
+        }
+        else if (bytes_per_pixel == 2)
+        {
+            const uint16x8x2_t top    = vld2q_u16(reinterpret_cast<const uint16_t *>(row0 + i * 2));
+            const uint16x8x2_t bottom = vld2q_u16(reinterpret_cast<const uint16_t *>(row1 + i * 2));
+            even = vrhaddq_u8(vreinterpretq_u8_u16(top.val[0]), vreinterpretq_u8_u16(bottom.val[0]));
+            odd  = vrhaddq_u8(vreinterpretq_u8_u16(top.val[1]), vreinterpretq_u8_u16(bottom.val[1]));
+        }
+        else
+        {
+            const uint32x4x2_t top    = vld2q_u32(reinterpret_cast<const uint32_t *>(row0 + i * 2));
+            const uint32x4x2_t bottom = vld2q_u32(reinterpret_cast<const uint32_t *>(row1 + i * 2));
+            even = vrhaddq_u8(vreinterpretq_u8_u32(top.val[0]), vreinterpretq_u8_u32(bottom.val[0]));
+            odd  = vrhaddq_u8(vreinterpretq_u8_u32(top.val[1]), vreinterpretq_u8_u32(bottom.val[1]));
+        }
+        vst1q_u8(dst + i, vrhaddq_u8(even, odd));
+    }
+#elif PIXEL_CONVERT_SSE2
+    for (; i + 16 <= out_bytes; i += 16)
+    {
+        const __m128i *top    = reinterpret_cast<const __m128i *>(row0 + i * 2);
+        const __m128i *bottom = reinterpret_cast<const __m128i *>(row1 + i * 2);
+        const __m128i  a      = _mm_avg_epu8(_mm_loadu_si128(top), _mm_loadu_si128(bottom));
+        const __m128i  b      = _mm_avg_epu8(_mm_loadu_si128(top + 1), _mm_loadu_si128(bottom + 1));
+        __m128i        even, odd;
+        deinterleave(a, b, bytes_per_pixel, even, odd);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_avg_epu8(even, odd));
+    }
+#endif
+    // The vector loops stop on a pixel boundary, as 16 is a multiple of every
+    // pixel size.
+    halve_rows_scalar(dst + i, row0 + i * 2, row1 + i * 2, (out_bytes - i) / bytes_per_pixel, bytes_per_pixel);
+}
+
+void halve_rows_scalar(unsigned char *dst, const unsigned char *row0, const unsigned char *row1, size_t out_pixels,
+                       size_t bytes_per_pixel)
+{
+    const size_t out_bytes = out_pixels * bytes_per_pixel;
+    for (size_t i = 0; i < out_bytes; ++i)
+    {
+        const size_t pixel = i / bytes_per_pixel, channel = i % bytes_per_pixel;
+        const size_t left  = pixel * 2 * bytes_per_pixel + channel;
+        const size_t right = left + bytes_per_pixel;
+        dst[i] = static_cast<unsigned char>((row0[left] + row0[right] + row1[left] + row1[right] + 2) >> 2);
+    }
+}
+
+const char *pixel_convert_simd()
+{
+#if PIXEL_CONVERT_NEON
+    return "neon";
+#elif PIXEL_CONVERT_SSSE3
+    return "ssse3";
+#elif PIXEL_CONVERT_SSE2
+    return "sse2";
+#else
+    return NULL;
+#endif
+}
+
+unsigned max_downscale_levels(const frame_format_t &format, unsigned max_levels)
+{
+    // NV12 chroma is already at half resolution and must halve evenly too.
+    uint32_t alignment;
+    switch (format.pixel_format)
+    {
+        case PIXEL_FORMAT_RGB24:
+        case PIXEL_FORMAT_Y8:
+            alignment = 2;
+            break;
+        case PIXEL_FORMAT_NV12:
+            alignment = 4;
+            break;
+        default:
+            return 0;
+    }
+    unsigned levels = 0;
+    while (levels < max_levels && format.width % alignment == 0 && format.height % alignment == 0)
+    {
+        alignment *= 2;
+        ++levels;
+    }
+    return levels;
+}
+
+frame_format_t downscaled_format(const frame_format_t &format, unsigned levels)
+{
+    frame_format_t downscaled = make_frame_format(format.width >> levels, format.height >> levels,
+                                                  format.pixel_format);
+    downscaled.fps = format.fps;
+    return downscaled;
+}
+
+void downscale_upload_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format,
+                            unsigned levels, bool swap_red_blue, std::vector<unsigned char> &scratch)
+{
+    if (levels == 0)
+    {
+        copy_upload_frame(dst, src, format, swap_red_blue);
+        return;
+    }
+
+    const bool     nv12   = format.pixel_format == PIXEL_FORMAT_NV12;
+    const size_t   bpp    = upload_pixel_bytes(format.pixel_format, false);
+    const size_t   rows   = format.pixel_format == PIXEL_FORMAT_RGB24 ? static_cast<size_t>(format.width) * 8 : 0;
+    uint32_t       width  = format.width / 2;
+    uint32_t       height = format.height / 2;
+
+    // Intermediate levels are halved in place behind the expanded rows in
+    // scratch, so dst only ever receives the final frame.
+    scratch.resize(rows + (levels > 1 ? upload_frame_bytes(downscaled_format(format, 1)) : 0));
+    unsigned char *level = levels > 1 ? scratch.data() + rows : dst;
+    if (format.pixel_format == PIXEL_FORMAT_RGB24)
+    {
+        // Expand two rows at a time so the full size frame is never stored.
+        unsigned char *row0 = scratch.data(), *row1 = row0 + static_cast<size_t>(format.width) * 4;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const unsigned char *src_row = src + 2 * static_cast<size_t>(y) * format.stride;
+            expand_rgb_to_rgba(row0, src_row, format.width, swap_red_blue);
+            expand_rgb_to_rgba(row1, src_row + format.stride, format.width, swap_red_blue);
+            halve_rows(level + static_cast<size_t>(y) * width * 4, row0, row1, width, 4);
+        }
+    }
+    else
+    {
+        halve_plane(level, src, format.stride, width, height, bpp);
+    }
+    if (nv12)
+    {
+        halve_plane(level + static_cast<size_t>(width) * height,
+                    src + static_cast<size_t>(format.stride) * format.height, format.stride, width / 2, height / 2, 2);
+    }
+
+    for (unsigned l = 1; l < levels; ++l)
+    {
+        halve_frame(l + 1 == levels ? dst : level, level, width, height, bpp, nv12);
+        width  /= 2;
+        height /= 2;
+    }
+}
+
+size_t upload_frame_bytes(const frame_format_t &format)
+{
+    if (format.pixel_format == PIXEL_FORMAT_RGB24)
+    {
+        return static_cast<size_t>(format.width) * format.height * 4;
+    }
+    return packed_frame_bytes(format);
+}
+
+void copy_upload_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format,
+                       bool swap_red_blue)
+{
+    if (format.pixel_format != PIXEL_FORMAT_RGB24)
+    {
+        copy_packed_frame(dst, src, format);
+        return;
+    }
+    if (format.stride == format.width * 3)
+    {
+        expand_rgb_to_rgba(dst, src, static_cast<size_t>(format.width) * format.height, swap_red_blue);
+        return;
+    }
+    for (uint32_t y = 0; y < format.height; ++y)
+    {
+        expand_rgb_to_rgba(dst + static_cast<size_t>(y) * format.width * 4,
+                           src + static_cast<size_t>(y) * format.stride, format.width, swap_red_blue);
+    }
+}
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// File: pixel_convert.h
+// Desc: Converts ingested frames into the layout they are uploaded in.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_PIXEL_CONVERT_H
+#define ANDROID_SHADER_DEMO_JNI_PIXEL_CONVERT_H
+
+#include <cstddef>
+#include <vector>
+
+#include "frame_source.h"
+
+/**
+ * \brief Expands packed 3-byte pixels to 4 bytes with an opaque alpha, using
+ *        NEON or SSSE3 where the target has them.
+ *
+ * @param dst - Must hold pixels * 4 bytes
+ * @param src - pixels * 3 bytes
+ * @param pixels
+ * @param swap_red_blue - Swap the first and third byte, e.g. BGR to RGBA
+ */
+void   expand_rgb_to_rgba(unsigned char *dst, const unsigned char *src, size_t pixels, bool swap_red_blue);
+
+/**
+ * \brief expand_rgb_to_rgba() without vector instructions, the reference its
+ *        vector paths are checked and measured against.
+ */
+void   expand_rgb_to_rgba_scalar(unsigned char *dst, const unsigned char *src, size_t pixels, bool swap_red_blue);
+
+/**
+ * \brief Returns the number of bytes one frame occupies as uploaded: packed
+ *        like packed_frame_bytes(), with RGB24 expanded to RGBA.
+ * @param format
+ * @return
+ */
+size_t upload_frame_bytes(const frame_format_t &format);
+
+/**
+ * \brief Copies one frame into its upload layout, dropping row padding and
+ *        expanding RGB24 to RGBA in the same pass.
+ *
+ * @param dst - Must hold upload_frame_bytes(format) bytes
+ * @param src - A frame laid out as described by format
+ * @param format
+ * @param swap_red_blue - The RGB24 source is stored as BGR
+ */
+void   copy_upload_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format,
+                         bool swap_red_blue);
+
+/**
+ * \brief Averages 2x2 blocks of two rows into one row of half the width.
+ *
+ * @param dst - out_pixels * bytes_per_pixel bytes; may alias row0
+ * @param row0
+ * @param row1 - The row below row0
+ * @param out_pixels
+ * @param bytes_per_pixel - 1, 2 or 4; every byte is averaged on its own
+ */
+void   halve_rows(unsigned char *dst, const unsigned char *row0, const unsigned char *row1, size_t out_pixels,
+                  size_t bytes_per_pixel);
+
+/**
+ * \brief halve_rows() without vector instructions.
+ */
+void   halve_rows_scalar(unsigned char *dst, const unsigned char *row0, const unsigned char *row1, size_t out_pixels,
+                         size_t bytes_per_pixel);
+
+/**
+ * \brief Names the vector instructions the kernels above were built with.
+ * @return "neon", "ssse3" (which expand_rgb_to_rgba() needs), "sse2", or NULL
+ *         if there are none
+ */
+const char *pixel_convert_simd();
+
+/**
+ * \brief Returns the largest number of times a frame of the given format can
+ *        be halved in each direction by downscale_upload_frame(), at most
+ *        max_levels. Bayer and 10-bit layouts are never downscaled.
+ * @param format
+ * @param max_levels
+ * @return
+ */
+unsigned       max_downscale_levels(const frame_format_t &format, unsigned max_levels);
+
+/**
+ * \brief Returns the packed format of a frame halved levels times.
+ * @param format
+ * @param levels
+ * @return
+ */
+frame_format_t downscaled_format(const frame_format_t &format, unsigned levels);
+
+/**
+ * \brief Like copy_upload_frame(), but box filters the frame down to
+ *        downscaled_format(format, levels) on the way.
+ *
+ * The first halving reads the source, later ones work in place in dst, so
+ * dst only ever holds the downscaled frame.
+ *
+ * @param dst - Must hold upload_frame_bytes(downscaled_format(format, levels)) bytes
+ * @param src
+ * @param format
+ * @param levels - At most max_downscale_levels(format, levels)
+ * @param swap_red_blue
+ * @param scratch - Reused between calls to hold expanded RGB24 rows
+ */
+void   downscale_upload_frame(unsigned char *dst, const unsigned char *src, const frame_format_t &format,
+                              unsigned levels, bool swap_red_blue, std::vector<unsigned char> &scratch);
+
+#endif //ANDROID_SHADER_DEMO_JNI_PIXEL_CONVERT_H
@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+// File: readback_pool.cpp
+// Desc: Fixed pool of aligned read back buffers shared through counted handles.
+//--------------------------------------------------------------------------------------
+#include "readback_pool.h"
+#include "log_sink.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#define LOG_TAG    "readback_pool.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+// Buffers start on a cache line, which also suits SIMD loads and stores.
+static const size_t BUFFER_ALIGNMENT = 64;
+
+struct readback_buffer::block_t
+{
+    std::atomic<uint32_t>                  refs;
+    unsigned char                         *data;
+    size_t                                 capacity;
+    // The pool's generation when the block was allocated.
+    uint32_t                               generation;
+    // Keeps the pool's bookkeeping alive for as long as the block is.
+    std::shared_ptr<readback_pool::core_t> core;
+};
+
+struct readback_pool::core_t
+{
+    std::mutex                              mutex;
+    std::vector<readback_buffer::block_t *> idle;
+    size_t                                  buffer_bytes;
+    // Bumped whenever the size changes, so blocks of an earlier size are
+    // freed when they come back even if the size has changed back since.
+    uint32_t                                generation;
+    // Blocks of the current generation in existence, idle or not.
+    size_t                                  allocated;
+    bool                                    alive;
+};
+
+void readback_buffer::free_block(block_t *block)
+{
+    std::free(block->data);
+    delete block;
+}
+
+readback_buffer::readback_buffer()
+    : m_block(NULL)
+{
+}
+
+readback_buffer::readback_buffer(block_t *block)
+    : m_block(block)
+{
+}
+
+readback_buffer::readback_buffer(const readback_buffer &other)
+    : m_block(other.m_block)
+{
+    if (m_block)
+    {
+        m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+readback_buffer::readback_buffer(readback_buffer &&other)
+    : m_block(other.m_block)
+{
+    other.m_block = NULL;
+}
+
+readback_buffer::~readback_buffer()
+{
+    release();
+}
+
+readback_buffer &readback_buffer::operator=(const readback_buffer &other)
+{
+    if (other.m_block)
+    {
+        other.m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    release();
+    m_block = other.m_block;
+    return *this;
+}
+
+readback_buffer &readback_buffer::operator=(readback_buffer &&other)
+{
+    if (this != &other)
+    {
+        release();
+        m_block       = other.m_block;
+        other.m_block = NULL;
+    }
+    return *this;
+}
+
+void readback_buffer::release()
+{
+    block_t *block = m_block;
+    m_block = NULL;
+    if (!block || block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    readback_pool::core_t &core = *block->core;
+    {
+        std::lock_guard<std::mutex> lock(core.mutex);
+        if (core.alive && block->generation == core.generation)
+        {
+            core.idle.push_back(block);
+            return;
+        }
+    }
+    // Outlived its pool or its generation; may free the core too.
+    free_block(block);
+}
+
+bool readback_buffer::valid() const
+{
+    return m_block != NULL;
+}
+
+unsigned char *readback_buffer::data() const
+{
+    return m_block ? m_block->data : NULL;
+}
+
+size_t readback_buffer::capacity() const
+{
+    return m_block ? m_block->capacity : 0;
+}
+
+readback_pool::readback_pool()
+    : m_core(new core_t())
+{
+    m_core->buffer_bytes = 0;
+    m_core->generation   = 0;
+    m_core->allocated    = 0;
+    m_core->alive        = true;
+}
+
+readback_pool::~readback_pool()
+{
+    std::vector<readback_buffer::block_t *> idle;
+    {
+        std::lock_guard<std::mutex> lock(m_core->mutex);
+        m_core->alive = false;
+        idle.swap(m_core->idle);
+    }
+    for (size_t i = 0; i < idle.size(); ++i)
+    {
+        readback_buffer::free_block(idle[i]);
+    }
+}
+
+bool readback_pool::reserve(size_t buffer_count, size_t buffer_bytes)
+{
+    std::vector<readback_buffer::block_t *> stale;
+    bool ok = true;
+    {
+        std::lock_guard<std::mutex> lock(m_core->mutex);
+        if (buffer_bytes != m_core->buffer_bytes)
+        {
+            stale.swap(m_core->idle);
+            m_core->buffer_bytes = buffer_bytes;
+            ++m_core->generation;
+            m_core->allocated    = 0;
+        }
+        // Room for every block, so handing one back never allocates.
+        m_core->idle.reserve(buffer_count);
+        while (m_core->allocated < buffer_count)
+        {
+            void *data = NULL;
+            if (posix_memalign(&data, BUFFER_ALIGNMENT, buffer_bytes) != 0)
+            {
+                EPRINTF1("Can't allocate a %zu byte read back buffer", buffer_bytes);
+                ok = false;
+                break;
+            }
+            readback_buffer::block_t *block = new readback_buffer::block_t();
+            block->refs       = 0;
+            block->data       = static_cast<unsigned char *>(data);
+            block->capacity   = buffer_bytes;
+            block->generation = m_core->generation;
+            block->core       = m_core;
+            m_core->idle.push_back(block);
+            ++m_core->allocated;
+        }
+    }
+    for (size_t i = 0; i < stale.size(); ++i)
+    {
+        readback_buffer::free_block(stale[i]);
+    }
+    return ok;
+}
+
+readback_buffer readback_pool::try_acquire()
+{
+    std::lock_guard<std::mutex> lock(m_core->mutex);
+    if (m_core->idle.empty())
+    {
+        return readback_buffer();
+    }
+    readback_buffer::block_t *block = m_core->idle.back();
+    m_core->idle.pop_back();
+    block->refs.store(1, std::memory_order_relaxed);
+    return readback_buffer(block);
+}
+
+size_t readback_pool::buffer_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_core->mutex);
+    return m_core->buffer_bytes;
+}
+
+size_t readback_pool::available() const
+{
+    std::lock_guard<std::mutex> lock(m_core->mutex);
+    return m_core->idle.size();
+}
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// File: readback_pool.h
+// Desc: Fixed pool of aligned read back buffers shared through counted handles.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_READBACK_POOL_H
+#define ANDROID_SHADER_DEMO_JNI_READBACK_POOL_H
+
+#include <cstddef>
+#include <memory>
+
+/**
+ * \brief A counted reference to one buffer of a readback_pool.
+ *
+ * Copies share the buffer; it goes back to its pool when the last of them is
+ * released or destroyed, on whichever thread that happens. Handles may be
+ * copied and released on different threads, but one handle object must not be
+ * used by two threads at once. A handle may outlive its pool, in which case
+ * the buffer is freed instead.
+ */
+class readback_buffer {
+public:
+    readback_buffer();
+    readback_buffer(const readback_buffer &other);
+    readback_buffer(readback_buffer &&other);
+    ~readback_buffer();
+
+    readback_buffer &operator=(const readback_buffer &other);
+    readback_buffer &operator=(readback_buffer &&other);
+
+    /**
+     * \brief Drops this reference, returning the buffer to its pool if it was
+     *        the last one. The handle is then empty.
+     */
+    void             release();
+
+    bool             valid() const;
+    unsigned char   *data() const;
+    size_t           capacity() const;
+
+private:
+    friend class readback_pool;
+    struct block_t;
+
+    explicit readback_buffer(block_t *block);
+    static void      free_block(block_t *block);
+
+    // Data members
+    block_t         *m_block;
+};
+
+/**
+ * \brief Buffers of one size, allocated up front and recycled, so that read
+ *        backs can be handed to consumers without allocating in steady state.
+ *
+ * Buffers are aligned to a cache line. Every method is thread-safe.
+ */
+class readback_pool {
+public:
+    readback_pool();
+
+    /**
+     * \brief Frees every idle buffer. Buffers still referenced are freed when
+     *        their last handle is released.
+     */
+    ~readback_pool();
+
+    /**
+     * \brief Makes buffer_count buffers of buffer_bytes each available.
+     *
+     * When the size changes, idle buffers are freed at once and ones in use
+     * when they come back, even if the size has changed back by then. Growing
+     * the count keeps the buffers already allocated.
+     *
+     * @param buffer_count
+     * @param buffer_bytes
+     * @return false if memory runs out
+     */
+    bool             reserve(size_t buffer_count, size_t buffer_bytes);
+
+    /**
+     * \brief Takes an idle buffer without waiting.
+     * @return a handle to it, or an empty handle if every buffer is in use
+     */
+    readback_buffer  try_acquire();
+
+    size_t           buffer_bytes() const;
+
+    /**
+     * \brief Gets the number of idle buffers, a snapshot when other threads
+     *        hold handles.
+     * @return
+     */
+    size_t           available() const;
+
+private:
+    friend class readback_buffer;
+    struct core_t;
+
+    // Data members
+    std::shared_ptr<core_t> m_core;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_READBACK_POOL_H
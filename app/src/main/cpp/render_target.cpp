@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// File: render_target.cpp
+// Desc: Offscreen framebuffer with a single texture colour attachment.
+//--------------------------------------------------------------------------------------
+#include "render_target.h"
+#include "log_sink.h"
+
+#include <cstddef>
+
+#define LOG_TAG    "render_target.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+render_target::render_target()
+    : m_framebuffer(0),
+      m_texture(0),
+      m_width(0),
+      m_height(0),
+      m_internal_format(0),
+      m_valid(false)
+{
+}
+
+bool render_target::create(uint32_t width, uint32_t height, GLenum internal_format, GLenum format, GLenum type)
+{
+    if (m_valid && m_width == width && m_height == height && m_internal_format == internal_format)
+    {
+        return true;
+    }
+
+    if (!m_texture)
+    {
+        glGenTextures(1, &m_texture);
+        glGenFramebuffers(1, &m_framebuffer);
+    }
+    m_width           = width;
+    m_height          = height;
+    m_internal_format = internal_format;
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    m_valid = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if (!m_valid)
+    {
+        EPRINTF1("%ux%u target of format 0x%x is not renderable", width, height, internal_format);
+    }
+    return m_valid;
+}
+
+void render_target::release()
+{
+    if (m_framebuffer)
+    {
+        glDeleteFramebuffers(1, &m_framebuffer);
+    }
+    if (m_texture)
+    {
+        glDeleteTextures(1, &m_texture);
+    }
+    abandon();
+}
+
+void render_target::abandon()
+{
+    m_framebuffer     = 0;
+    m_texture         = 0;
+    m_width           = 0;
+    m_height          = 0;
+    m_internal_format = 0;
+    m_valid           = false;
+}
+
+bool render_target::valid() const
+{
+    return m_valid;
+}
+
+GLuint render_target::framebuffer() const
+{
+    return m_framebuffer;
+}
+
+GLuint render_target::texture() const
+{
+    return m_texture;
+}
+
+uint32_t render_target::width() const
+{
+    return m_width;
+}
+
+uint32_t render_target::height() const
+{
+    return m_height;
+}
+
+GLenum render_target::internal_format() const
+{
+    return m_internal_format;
+}
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: render_target.h
+// Desc: Offscreen framebuffer with a single texture colour attachment.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_RENDER_TARGET_H
+#define ANDROID_SHADER_DEMO_JNI_RENDER_TARGET_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+
+/**
+ * \brief A framebuffer object rendering into one texture.
+ *
+ * All methods need the GL context the target was created on to be current.
+ */
+class render_target {
+public:
+    render_target();
+
+    /**
+     * \brief Allocates the texture and framebuffer, or reallocates them if the
+     *        size or format differs from the current one. Leaves the
+     *        framebuffer binding unchanged.
+     *
+     * @param width
+     * @param height
+     * @param internal_format - e.g. GL_RGBA, GL_RGBA16F, GL_RGB10_A2
+     * @param format - Client format matching internal_format, e.g. GL_RGBA
+     * @param type - Client type matching internal_format, e.g. GL_HALF_FLOAT
+     * @return false if the combination is not colour-renderable here
+     */
+    bool          create(uint32_t width, uint32_t height, GLenum internal_format, GLenum format, GLenum type);
+
+    /**
+     * \brief Frees the texture and framebuffer.
+     */
+    void          release();
+
+    /**
+     * \brief Forgets the texture and framebuffer without deleting them, once
+     *        the context they were created on is gone. Needs no context.
+     */
+    void          abandon();
+
+    bool          valid() const;
+    GLuint        framebuffer() const;
+    GLuint        texture() const;
+    uint32_t      width() const;
+    uint32_t      height() const;
+    GLenum        internal_format() const;
+
+private:
+    // Data members
+    GLuint        m_framebuffer;
+    GLuint        m_texture;
+    uint32_t      m_width;
+    uint32_t      m_height;
+    GLenum        m_internal_format;
+    bool          m_valid;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_RENDER_TARGET_H
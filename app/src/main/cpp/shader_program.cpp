@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// File: shader_program.cpp
+// Desc: Compiles and links the GLSL programs the compositor draws with.
+//--------------------------------------------------------------------------------------
+#include "shader_program.h"
+#include "log_sink.h"
+
+#include <cstddef>
+#include <vector>
+
+#define LOG_TAG    "shader_program.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+GLuint compile_shader(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    if (!shader)
+    {
+        return 0;
+    }
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length > 0 ? length : 1, '\0');
+        glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), NULL, log.data());
+        EPRINTF1("Could not compile shader %d:\n%s", type, log.data());
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint build_program(const char *vertex_source, const char *fragment_source)
+{
+    GLuint vertex_shader   = compile_shader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+    GLuint program         = 0;
+    if (vertex_shader && fragment_shader)
+    {
+        program = glCreateProgram();
+        glAttachShader(program, vertex_shader);
+        glAttachShader(program, fragment_shader);
+        glLinkProgram(program);
+
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            GLint length = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::vector<char> log(length > 0 ? length : 1, '\0');
+            glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), NULL, log.data());
+            EPRINTF1("Could not link program:\n%s", log.data());
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    // Deleting 0 is a no-op, and attached shaders live on with the program.
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    return program;
+}
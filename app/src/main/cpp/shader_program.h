@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// File: shader_program.h
+// Desc: Compiles and links the GLSL programs the compositor draws with.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_SHADER_PROGRAM_H
+#define ANDROID_SHADER_DEMO_JNI_SHADER_PROGRAM_H
+
+#include <GLES2/gl2.h>
+
+/**
+ * \brief Compiles one shader, logging the info log if it fails.
+ *
+ * Needs a current GL context.
+ *
+ * @param type - GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+ * @param source
+ * @return the shader, or 0 if it doesn't compile
+ */
+GLuint compile_shader(GLenum type, const char *source);
+
+/**
+ * \brief Compiles both shaders and links them into a program, logging the
+ *        info log of whichever step fails. The shaders are only kept alive
+ *        by the program.
+ *
+ * Needs a current GL context.
+ *
+ * @param vertex_source
+ * @param fragment_source
+ * @return the program, or 0 if it can't be built
+ */
+GLuint build_program(const char *vertex_source, const char *fragment_source);
+
+#endif //ANDROID_SHADER_DEMO_JNI_SHADER_PROGRAM_H
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// File: spsc_queue.h
+// Desc: Bounded lock-free queue for exactly one producer and one consumer thread.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_SPSC_QUEUE_H
+#define ANDROID_SHADER_DEMO_JNI_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * \brief A fixed-capacity FIFO connecting two pipeline stages without locks.
+ *
+ * Only one thread may push and only one other thread may pop. Neither side
+ * ever waits: a full or empty queue is reported and the caller decides
+ * whether to retry, back off or drop. The two indices live on separate cache
+ * lines so the producer and consumer don't invalidate each other's line on
+ * every operation.
+ */
+template <typename T>
+class spsc_queue {
+public:
+    /**
+     * \brief Allocates room for capacity items.
+     * @param capacity
+     */
+    explicit spsc_queue(size_t capacity)
+        : m_items(capacity + 1),
+          m_head(0),
+          m_tail(0)
+    {
+    }
+
+    /**
+     * \brief Appends an item. Producer thread only.
+     * @param item
+     * @return false if the queue is full
+     */
+    bool     try_push(const T &item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = advance(tail);
+        if (next == m_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        m_items[tail] = item;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Removes the oldest item. Consumer thread only.
+     * @param item [out]
+     * @return false if the queue is empty
+     */
+    bool     try_pop(T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = m_items[head];
+        m_head.store(advance(head), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Returns true if nothing is queued. Exact only on the consumer
+     *        thread; elsewhere it is a snapshot.
+     * @return
+     */
+    bool     empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t   capacity() const
+    {
+        return m_items.size() - 1;
+    }
+
+private:
+    // One slot is always left free to tell a full queue from an empty one.
+    size_t   advance(size_t index) const
+    {
+        return index + 1 == m_items.size() ? 0 : index + 1;
+    }
+
+    // Assumed size of a cache line.
+    static const size_t CACHE_LINE = 64;
+
+    // Data members
+    std::vector<T>      m_items;
+    char                m_pad0[CACHE_LINE];
+    // Next item to pop, written by the consumer.
+    std::atomic<size_t> m_head;
+    char                m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    // Next slot to fill, written by the producer.
+    std::atomic<size_t> m_tail;
+    char                m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_SPSC_QUEUE_H
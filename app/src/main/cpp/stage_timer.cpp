@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: stage_timer.cpp
+// Desc: Wall-clock timing of a repeated pipeline stage.
+//--------------------------------------------------------------------------------------
+#include "stage_timer.h"
+
+stage_timer::stage_timer()
+    : m_count(0),
+      m_last_ms(0.0),
+      m_total_ms(0.0),
+      m_max_ms(0.0)
+{
+}
+
+void stage_timer::begin()
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+double stage_timer::end()
+{
+    add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+    return m_last_ms;
+}
+
+void stage_timer::add(double ms)
+{
+    m_last_ms   = ms;
+    m_total_ms += ms;
+    if (ms > m_max_ms)
+    {
+        m_max_ms = ms;
+    }
+    ++m_count;
+}
+
+void stage_timer::reset()
+{
+    m_count    = 0;
+    m_last_ms  = 0.0;
+    m_total_ms = 0.0;
+    m_max_ms   = 0.0;
+}
+
+uint64_t stage_timer::count() const
+{
+    return m_count;
+}
+
+double stage_timer::last_ms() const
+{
+    return m_last_ms;
+}
+
+double stage_timer::mean_ms() const
+{
+    return m_count ? m_total_ms / m_count : 0.0;
+}
+
+double stage_timer::max_ms() const
+{
+    return m_max_ms;
+}
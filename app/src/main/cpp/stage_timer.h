@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// File: stage_timer.h
+// Desc: Wall-clock timing of a repeated pipeline stage.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_STAGE_TIMER_H
+#define ANDROID_SHADER_DEMO_JNI_STAGE_TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * \brief Accumulates the duration of every begin()/end() pair, e.g. one
+ *        texture upload per frame, so the cost of a stage can be logged as a
+ *        mean and a worst case rather than one noisy sample.
+ */
+class stage_timer {
+public:
+    stage_timer();
+
+    void          begin();
+
+    /**
+     * \brief Closes the interval opened by begin() and adds it to the totals.
+     * @return the interval in milliseconds
+     */
+    double        end();
+
+    /**
+     * \brief Adds an interval measured elsewhere, e.g. one that spans frames.
+     * @param ms
+     */
+    void          add(double ms);
+
+    /**
+     * \brief Clears the totals, e.g. after they were logged.
+     */
+    void          reset();
+
+    uint64_t      count() const;
+    double        last_ms() const;
+    double        mean_ms() const;
+    double        max_ms() const;
+
+private:
+    // Data members
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t      m_count;
+    double        m_last_ms;
+    double        m_total_ms;
+    double        m_max_ms;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_STAGE_TIMER_H
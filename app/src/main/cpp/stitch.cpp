@@ -0,0 +1,267 @@
+//--------------------------------------------------------------------------------------
+// File: stitch.cpp
+// Desc: Command-line tool stitching the streams of manifests into raw output
+//       files on headless contexts.
+//--------------------------------------------------------------------------------------
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compositor.h"
+#include "headless_driver.h"
+#include "log_sink.h"
+#include "pixel_convert.h"
+
+namespace
+{
+// One manifest stitched into one output file, on its own thread and context.
+struct job_t
+{
+    std::string       manifest_path;
+    std::string       output_path;
+    bool              ok;
+    headless_report_t report;
+};
+
+void usage(const char *program)
+{
+    std::fprintf(stderr,
+                 "usage: %s [-s <width>x<height>] [-n <frames>] [-v] <manifest> <output> [<manifest> <output>...]\n"
+                 "       %s -b\n"
+                 "  -s  size of the default framebuffer, and of the output unless the\n"
+                 "      manifest has an output line (default 1920x1080)\n"
+                 "  -n  stop after this many frames (default: when every stream ended)\n"
+                 "  -v  log everything, not just warnings and errors\n"
+                 "  -b  measure the ingest pixel conversion kernels and exit\n"
+                 "Several manifests are stitched in parallel, each by its own compositor.\n",
+                 program, program);
+}
+
+void run_job(job_t &job, int width, int height, unsigned long long max_frames)
+{
+    job.ok = false;
+    headless_driver driver;
+    if (!driver.create(width, height))
+    {
+        std::fprintf(stderr, "can't create a %dx%d OpenGL ES context\n", width, height);
+        return;
+    }
+    if (!driver.get_compositor()->set_output(job.output_path))
+    {
+        std::fprintf(stderr, "can't write %s\n", job.output_path.c_str());
+        return;
+    }
+    if (!driver.run(job.manifest_path, NULL, NULL, max_frames, job.report))
+    {
+        std::fprintf(stderr, "can't stitch the streams of %s\n", job.manifest_path.c_str());
+        // Don't leave an empty output behind that looks like a result.
+        driver.get_compositor()->set_output(std::string());
+        std::remove(job.output_path.c_str());
+        return;
+    }
+    job.ok = driver.get_compositor()->set_output(std::string());
+}
+
+void print_stage(const char *name, const stage_timer &timer)
+{
+    std::printf("  %-9s mean %8.3lf ms  max %8.3lf ms\n", name, timer.mean_ms(), timer.max_ms());
+}
+
+// The kernel benchmark converts frames of this size, passes times over.
+const uint32_t BENCH_WIDTH  = 1920;
+const uint32_t BENCH_HEIGHT = 1080;
+const int      BENCH_PASSES = 100;
+
+// One ingest kernel run over a whole frame, with and without vector code.
+// src holds src_bytes and dst dst_bytes per source pixel. The two paths may
+// differ by up to tolerance per byte: vector halving averages in two rounded
+// steps.
+struct bench_kernel_t
+{
+    const char *name;
+    size_t      src_bytes;
+    size_t      dst_bytes;
+    int         tolerance;
+    void      (*simd)(unsigned char *dst, const unsigned char *src);
+    void      (*scalar)(unsigned char *dst, const unsigned char *src);
+};
+
+template <size_t BytesPerPixel, bool Scalar>
+void bench_halve(unsigned char *dst, const unsigned char *src)
+{
+    const size_t stride = BENCH_WIDTH * BytesPerPixel;
+    for (uint32_t y = 0; y < BENCH_HEIGHT / 2; ++y)
+    {
+        const unsigned char *row0 = src + 2 * y * stride;
+        unsigned char       *out  = dst + y * stride / 2;
+        if (Scalar)
+        {
+            halve_rows_scalar(out, row0, row0 + stride, BENCH_WIDTH / 2, BytesPerPixel);
+        }
+        else
+        {
+            halve_rows(out, row0, row0 + stride, BENCH_WIDTH / 2, BytesPerPixel);
+        }
+    }
+}
+
+const bench_kernel_t BENCH_KERNELS[] = {
+    { "expand rgb", 3, 4, 0,
+      [](unsigned char *dst, const unsigned char *src) { expand_rgb_to_rgba(dst, src, BENCH_WIDTH * BENCH_HEIGHT, false); },
+      [](unsigned char *dst, const unsigned char *src) { expand_rgb_to_rgba_scalar(dst, src, BENCH_WIDTH * BENCH_HEIGHT, false); } },
+    { "expand bgr", 3, 4, 0,
+      [](unsigned char *dst, const unsigned char *src) { expand_rgb_to_rgba(dst, src, BENCH_WIDTH * BENCH_HEIGHT, true); },
+      [](unsigned char *dst, const unsigned char *src) { expand_rgb_to_rgba_scalar(dst, src, BENCH_WIDTH * BENCH_HEIGHT, true); } },
+    { "halve y8", 1, 1, 1, bench_halve<1, false>, bench_halve<1, true> },
+    { "halve rgba", 4, 4, 1, bench_halve<4, false>, bench_halve<4, true> },
+};
+
+// Bytes read plus bytes written per second by BENCH_PASSES runs of kernel.
+double bench_gbps(void (*kernel)(unsigned char *, const unsigned char *), unsigned char *dst,
+                  const unsigned char *src, size_t bytes)
+{
+    kernel(dst, src);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < BENCH_PASSES; ++pass)
+    {
+        kernel(dst, src);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? bytes * static_cast<double>(BENCH_PASSES) / (seconds * 1e9) : 0.0;
+}
+
+// Times every kernel's scalar and vector path on the same frame, and checks
+// that they agree. Returns false if one doesn't.
+bool run_kernel_benchmark()
+{
+    const size_t pixels = static_cast<size_t>(BENCH_WIDTH) * BENCH_HEIGHT;
+    std::vector<unsigned char> src(pixels * 4), simd_dst(pixels * 4), scalar_dst(pixels * 4);
+    unsigned seed = 1;
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        src[i] = static_cast<unsigned char>(seed >> 16);
+    }
+
+    const char *simd = pixel_convert_simd();
+    std::printf("%ux%u frames, GB/s read plus written:\n", BENCH_WIDTH, BENCH_HEIGHT);
+    bool ok = true;
+    for (size_t k = 0; k < sizeof(BENCH_KERNELS) / sizeof(BENCH_KERNELS[0]); ++k)
+    {
+        const bench_kernel_t &kernel = BENCH_KERNELS[k];
+        const size_t dst_bytes = kernel.dst_bytes * pixels / (kernel.src_bytes == kernel.dst_bytes ? 4 : 1);
+        const size_t bytes     = kernel.src_bytes * pixels + dst_bytes;
+        const double scalar    = bench_gbps(kernel.scalar, scalar_dst.data(), src.data(), bytes);
+        if (!simd)
+        {
+            std::printf("  %-10s scalar %7.2lf\n", kernel.name, scalar);
+            continue;
+        }
+        const double vector = bench_gbps(kernel.simd, simd_dst.data(), src.data(), bytes);
+        bool         same   = true;
+        for (size_t i = 0; i < dst_bytes && same; ++i)
+        {
+            same = std::abs(simd_dst[i] - scalar_dst[i]) <= kernel.tolerance;
+        }
+        std::printf("  %-10s scalar %7.2lf  %-5s %7.2lf  %4.1lfx%s\n", kernel.name, scalar, simd, vector,
+                    scalar > 0.0 ? vector / scalar : 0.0, same ? "" : "  MISMATCH");
+        ok = ok && same;
+    }
+    return ok;
+}
+}
+
+int main(int argc, char **argv)
+{
+    int                width      = 1920;
+    int                height     = 1080;
+    unsigned long long max_frames = 0;
+    bool               verbose    = false;
+    int                arg        = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (std::strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            if (std::sscanf(argv[++arg], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (std::strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+        {
+            max_frames = std::strtoull(argv[++arg], NULL, 10);
+        }
+        else if (std::strcmp(argv[arg], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (std::strcmp(argv[arg], "-b") == 0)
+        {
+            return run_kernel_benchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - arg < 2 || (argc - arg) % 2 != 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<job_t> jobs((argc - arg) / 2);
+    for (size_t j = 0; j < jobs.size(); ++j)
+    {
+        jobs[j].manifest_path = argv[arg + 2 * j];
+        jobs[j].output_path   = argv[arg + 2 * j + 1];
+    }
+
+    set_log_level(verbose ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t j = 0; j < jobs.size(); ++j)
+    {
+        threads.push_back(std::thread(run_job, std::ref(jobs[j]), width, height, max_frames));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool               ok     = true;
+    unsigned long long frames = 0;
+    for (size_t j = 0; j < jobs.size(); ++j)
+    {
+        const job_t &job = jobs[j];
+        ok = ok && job.ok;
+        if (!job.ok)
+        {
+            continue;
+        }
+        frames += job.report.frames;
+        std::printf("%s: %llu frames in %.3lf s, %.1lf fps\n", job.manifest_path.c_str(),
+                    (unsigned long long) job.report.frames, job.report.seconds, job.report.fps);
+        print_stage("upload", job.report.stages.upload);
+        print_stage("draw", job.report.stages.draw);
+        print_stage("readback", job.report.stages.readback);
+        print_stage("encode", job.report.stages.encode);
+        if (job.report.stages.dropped)
+        {
+            std::printf("  dropped %llu frames\n", (unsigned long long) job.report.stages.dropped);
+        }
+    }
+    if (jobs.size() > 1)
+    {
+        std::printf("total: %llu frames in %.3lf s, %.1lf fps\n", frames, seconds, seconds > 0.0 ? frames / seconds : 0.0);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,252 @@
+//--------------------------------------------------------------------------------------
+// File: stream_container.cpp
+// Desc: Self-describing raw stream recordings with a trailing frame index.
+//--------------------------------------------------------------------------------------
+#include "stream_container.h"
+#include "log_sink.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "CL/cl_ext_qcom.h"
+
+#define LOG_TAG    "stream_container.cpp"
+
+#define DPRINTF1(...)  log_print(LOG_LEVEL_DEBUG,LOG_TAG,__VA_ARGS__)
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+// Frame rates are stored as a fraction over this denominator.
+static const uint32_t FPS_DENOMINATOR = 1000;
+
+bool pixel_format_from_cl(uint32_t data_type, uint32_t order, pixel_format_t &pixel_format)
+{
+    if (data_type == CL_UNORM_INT8 && order == CL_RGB)
+    {
+        pixel_format = PIXEL_FORMAT_RGB24;
+        return true;
+    }
+    if (data_type == CL_UNORM_INT8 && order == CL_QCOM_NV12)
+    {
+        pixel_format = PIXEL_FORMAT_NV12;
+        return true;
+    }
+    if (data_type == CL_UNORM_INT8 && order == CL_LUMINANCE)
+    {
+        pixel_format = PIXEL_FORMAT_Y8;
+        return true;
+    }
+    if (data_type == CL_QCOM_UNORM_MIPI10 && order == CL_QCOM_BAYER)
+    {
+        pixel_format = PIXEL_FORMAT_MIPI10;
+        return true;
+    }
+    if (data_type == CL_QCOM_UNORM_INT10 && order == CL_QCOM_P010)
+    {
+        pixel_format = PIXEL_FORMAT_P010;
+        return true;
+    }
+    if (data_type == CL_QCOM_UNORM_INT10 && order == CL_QCOM_TP10)
+    {
+        pixel_format = PIXEL_FORMAT_TP10;
+        return true;
+    }
+    return false;
+}
+
+void pixel_format_to_cl(pixel_format_t pixel_format, uint32_t &data_type, uint32_t &order)
+{
+    switch (pixel_format)
+    {
+        case PIXEL_FORMAT_RGB24:
+            data_type = CL_UNORM_INT8;
+            order     = CL_RGB;
+            break;
+        case PIXEL_FORMAT_NV12:
+            data_type = CL_UNORM_INT8;
+            order     = CL_QCOM_NV12;
+            break;
+        case PIXEL_FORMAT_Y8:
+            data_type = CL_UNORM_INT8;
+            order     = CL_LUMINANCE;
+            break;
+        case PIXEL_FORMAT_MIPI10:
+            data_type = CL_QCOM_UNORM_MIPI10;
+            order     = CL_QCOM_BAYER;
+            break;
+        case PIXEL_FORMAT_P010:
+            data_type = CL_QCOM_UNORM_INT10;
+            order     = CL_QCOM_P010;
+            break;
+        case PIXEL_FORMAT_TP10:
+            data_type = CL_QCOM_UNORM_INT10;
+            order     = CL_QCOM_TP10;
+            break;
+    }
+}
+
+stream_writer::stream_writer()
+    : m_frame_bytes(0)
+{
+    std::memset(&m_header, 0, sizeof(m_header));
+}
+
+stream_writer::~stream_writer()
+{
+    close();
+}
+
+bool stream_writer::open(const std::string &filename, const frame_format_t &format)
+{
+    close();
+
+    m_out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!m_out)
+    {
+        EPRINTF1("Can't open %s for writing.", filename.c_str());
+        return false;
+    }
+
+    std::memset(&m_header, 0, sizeof(m_header));
+    m_header.width  = format.width;
+    m_header.height = format.height;
+    m_header.stride = format.stride;
+    pixel_format_to_cl(format.pixel_format, m_header.data_type, m_header.order);
+    m_header.fps_num = static_cast<uint32_t>(std::lround(format.fps * FPS_DENOMINATOR));
+    m_header.fps_den = FPS_DENOMINATOR;
+
+    m_frame_bytes = frame_bytes(format);
+    m_index.clear();
+    write_stream_header(m_out, m_header);
+    return static_cast<bool>(m_out);
+}
+
+bool stream_writer::append(const unsigned char *frame, uint64_t timestamp_us)
+{
+    if (!m_out.is_open())
+    {
+        return false;
+    }
+
+    stream_index_entry_t entry;
+    entry.offset       = static_cast<uint64_t>(m_out.tellp());
+    entry.timestamp_us = timestamp_us;
+    m_out.write(reinterpret_cast<const char *>(frame), static_cast<std::streamsize>(m_frame_bytes));
+    if (!m_out)
+    {
+        return false;
+    }
+    m_index.push_back(entry);
+    return true;
+}
+
+bool stream_writer::close()
+{
+    if (!m_out.is_open())
+    {
+        return true;
+    }
+
+    m_header.frame_count  = m_index.size();
+    m_header.index_offset = static_cast<uint64_t>(m_out.tellp());
+    write_stream_index(m_out, m_index);
+    m_out.seekp(0, std::ios::beg);
+    write_stream_header(m_out, m_header);
+
+    const bool ok = static_cast<bool>(m_out);
+    m_out.close();
+    return ok;
+}
+
+size_t stream_writer::frame_count() const
+{
+    return m_index.size();
+}
+
+container_frame_source::container_frame_source()
+{
+    std::memset(&m_header, 0, sizeof(m_header));
+}
+
+bool container_frame_source::open(const std::string &filename)
+{
+    close();
+    m_index.clear();
+
+    std::ifstream fin(filename, std::ios::binary);
+    if (!fin)
+    {
+        EPRINTF1("Can't open %s for reading", filename.c_str());
+        return false;
+    }
+
+    pixel_format_t pixel_format;
+    if (!read_stream_header(fin, m_header)
+        || !pixel_format_from_cl(m_header.data_type, m_header.order, pixel_format))
+    {
+        EPRINTF1("%s is not a raw stream container of a supported format", filename.c_str());
+        return false;
+    }
+    if (!read_stream_index(fin, m_header, m_index))
+    {
+        EPRINTF1("%s has a truncated or corrupt frame index", filename.c_str());
+        return false;
+    }
+
+    const char *format_error = frame_format_error(m_header.width, m_header.height, pixel_format);
+    if (format_error)
+    {
+        EPRINTF1("%s holds %ux%u frames, but %s", filename.c_str(), m_header.width, m_header.height,
+                 format_error);
+        return false;
+    }
+
+    frame_format_t format = make_frame_format(m_header.width, m_header.height, pixel_format);
+    if (m_header.stride < format.stride)
+    {
+        EPRINTF1("%s has a row stride of %u bytes, less than one row", filename.c_str(), m_header.stride);
+        return false;
+    }
+    format.stride = m_header.stride;
+    format.fps    = m_header.fps_den ? static_cast<double>(m_header.fps_num) / m_header.fps_den : 0.0;
+
+    if (!map_file(filename))
+    {
+        return false;
+    }
+    m_format      = format;
+    m_frame_bytes = frame_bytes(format);
+    // Frames live between the header and the index; compare against what's
+    // left of that region so a hostile offset can't overflow the sum.
+    for (size_t i = 0; i < m_index.size(); ++i)
+    {
+        const uint64_t offset = m_index[i].offset;
+        if (offset < STREAM_HEADER_SIZE || offset > m_header.index_offset
+            || m_frame_bytes > m_header.index_offset - offset)
+        {
+            EPRINTF1("%s: frame %zu lies outside the frame data", filename.c_str(), i);
+            close();
+            return false;
+        }
+    }
+    m_frame_count = m_index.size();
+
+    DPRINTF1("opened %s: %zu frames of %ux%u at %.3f fps", filename.c_str(), m_frame_count,
+             format.width, format.height, format.fps);
+    seek(0);
+    return true;
+}
+
+uint64_t container_frame_source::timestamp_us(size_t index) const
+{
+    return index < m_index.size() ? m_index[index].timestamp_us : 0;
+}
+
+const stream_header_t &container_frame_source::header() const
+{
+    return m_header;
+}
+
+size_t container_frame_source::frame_offset(size_t index) const
+{
+    return static_cast<size_t>(m_index[index].offset);
+}
@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// File: stream_container.h
+// Desc: Self-describing raw stream recordings with a trailing frame index.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_STREAM_CONTAINER_H
+#define ANDROID_SHADER_DEMO_JNI_STREAM_CONTAINER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+#include "util.h"
+
+/**
+ * \brief Maps a container's CL data type and channel order to a pixel format.
+ *
+ * @param data_type
+ * @param order
+ * @param pixel_format [out]
+ * @return false if the combination is not a supported pixel format
+ */
+bool pixel_format_from_cl(uint32_t data_type, uint32_t order, pixel_format_t &pixel_format);
+
+/**
+ * \brief Gets the CL data type and channel order a container records for a
+ *        pixel format.
+ *
+ * @param pixel_format
+ * @param data_type [out]
+ * @param order [out]
+ */
+void pixel_format_to_cl(pixel_format_t pixel_format, uint32_t &data_type, uint32_t &order);
+
+/**
+ * \brief Writes frames into a raw stream container (see stream_header_t).
+ *
+ * Frames are appended back to back after the header. close() writes the frame
+ * index after the last frame and patches its location into the header.
+ */
+class stream_writer {
+public:
+    stream_writer();
+
+    /**
+     * \brief Finishes the file, if one is open.
+     */
+    ~stream_writer();
+
+    /**
+     * \brief Creates the file and writes a provisional header.
+     *
+     * @param filename
+     * @param format - Layout of the frames passed to append()
+     * @return false if the file can't be created
+     */
+    bool          open(const std::string &filename, const frame_format_t &format);
+
+    /**
+     * \brief Appends one frame of frame_bytes(format) bytes.
+     *
+     * @param frame
+     * @param timestamp_us
+     * @return false on a write error
+     */
+    bool          append(const unsigned char *frame, uint64_t timestamp_us);
+
+    /**
+     * \brief Writes the frame index and the final header, then closes the file.
+     * @return false on a write error
+     */
+    bool          close();
+
+    size_t        frame_count() const;
+
+private:
+    // Data members
+    std::ofstream                     m_out;
+    stream_header_t                   m_header;
+    size_t                            m_frame_bytes;
+    std::vector<stream_index_entry_t> m_index;
+};
+
+/**
+ * \brief A mapped_frame_source over a raw stream container.
+ *
+ * The format comes from the container header, and every frame is located
+ * through the index, so seeking to or skipping over frames never touches
+ * their data.
+ */
+class container_frame_source : public mapped_frame_source {
+public:
+    container_frame_source();
+
+    /**
+     * \brief Reads the header and index, then maps the file.
+     *
+     * @param filename
+     * @return false if the file is not a valid container of a supported format
+     */
+    bool                   open(const std::string &filename);
+
+    /**
+     * \brief Gets the capture time of the given frame.
+     * @param index
+     * @return
+     */
+    uint64_t               timestamp_us(size_t index) const;
+
+    const stream_header_t &header() const;
+
+protected:
+    size_t                 frame_offset(size_t index) const;
+
+private:
+    // Data members
+    stream_header_t                   m_header;
+    std::vector<stream_index_entry_t> m_index;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_STREAM_CONTAINER_H
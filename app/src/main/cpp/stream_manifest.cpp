@@ -0,0 +1,375 @@
+//--------------------------------------------------------------------------------------
+// File: stream_manifest.cpp
+// Desc: Binds independent input streams to the tiles of the composite.
+//--------------------------------------------------------------------------------------
+#include "stream_manifest.h"
+#include "log_sink.h"
+
+#include <fstream>
+#include <sstream>
+
+#define LOG_TAG    "stream_manifest.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+bool parse_pixel_format(const std::string &name, pixel_format_t &pixel_format)
+{
+    if (name == "rgb24")
+    {
+        pixel_format = PIXEL_FORMAT_RGB24;
+        return true;
+    }
+    if (name == "nv12")
+    {
+        pixel_format = PIXEL_FORMAT_NV12;
+        return true;
+    }
+    if (name == "y8")
+    {
+        pixel_format = PIXEL_FORMAT_Y8;
+        return true;
+    }
+    if (name == "mipi10")
+    {
+        pixel_format = PIXEL_FORMAT_MIPI10;
+        return true;
+    }
+    if (name == "p010")
+    {
+        pixel_format = PIXEL_FORMAT_P010;
+        return true;
+    }
+    if (name == "tp10")
+    {
+        pixel_format = PIXEL_FORMAT_TP10;
+        return true;
+    }
+    return false;
+}
+
+static bool find_stream(const stream_manifest_t &manifest, const std::string &name, size_t &index)
+{
+    for (size_t i = 0; i < manifest.streams.size(); ++i)
+    {
+        if (manifest.streams[i].name == name)
+        {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool load_stream_manifest(const std::string &filename, stream_manifest_t &manifest)
+{
+    std::ifstream fin(filename);
+    if (!fin)
+    {
+        EPRINTF1("Can't open %s for reading", filename.c_str());
+        return false;
+    }
+
+    manifest.streams.clear();
+    manifest.tile_streams.clear();
+    manifest.readback      = READBACK_RGBA8;
+    manifest.readback_mode = READBACK_SYNC;
+    manifest.upload        = UPLOAD_DIRECT;
+    manifest.atlas         = false;
+    manifest.instanced     = false;
+    manifest.layout        = make_grid_layout();
+    manifest.output_width  = 0;
+    manifest.output_height = 0;
+    manifest.preview       = true;
+    manifest.top_down      = false;
+
+    std::string line;
+    for (int line_no = 1; std::getline(fin, line); ++line_no)
+    {
+        std::istringstream strm(line);
+        std::string        directive;
+        if (!(strm >> directive) || directive[0] == '#')
+        {
+            continue;
+        }
+
+        if (directive == "stream")
+        {
+            stream_desc_t desc;
+            uint32_t      width = 0, height = 0;
+            std::string   format_name("rgb24");
+            pixel_format_t pixel_format;
+            if (!(strm >> desc.name >> desc.path))
+            {
+                EPRINTF1("%s:%d: expected 'stream <name> <path> [<width> <height> [format]]'", filename.c_str(), line_no);
+                return false;
+            }
+            // Without dimensions the file is a container that carries its own format.
+            if ((strm >> width) && (!(strm >> height) || width == 0 || height == 0))
+            {
+                EPRINTF1("%s:%d: expected 'stream <name> <path> [<width> <height> [format]]'", filename.c_str(), line_no);
+                return false;
+            }
+            if (width == 0)
+            {
+                // A format without dimensions, e.g. "stream a path nv12", fails the width read.
+                std::string trailing;
+                strm.clear();
+                if (strm >> trailing)
+                {
+                    EPRINTF1("%s:%d: expected <width> <height> before %s", filename.c_str(), line_no, trailing.c_str());
+                    return false;
+                }
+            }
+            strm >> format_name;
+            if (!parse_pixel_format(format_name, pixel_format))
+            {
+                EPRINTF1("%s:%d: unknown pixel format %s", filename.c_str(), line_no, format_name.c_str());
+                return false;
+            }
+            // A container's format is checked when it is opened.
+            const char *format_error = width ? frame_format_error(width, height, pixel_format) : NULL;
+            if (format_error)
+            {
+                EPRINTF1("%s:%d: %s", filename.c_str(), line_no, format_error);
+                return false;
+            }
+            size_t existing;
+            if (find_stream(manifest, desc.name, existing))
+            {
+                EPRINTF1("%s:%d: stream %s declared twice", filename.c_str(), line_no, desc.name.c_str());
+                return false;
+            }
+            desc.format     = make_frame_format(width, height, pixel_format);
+            desc.yuv_matrix = YUV_MATRIX_BT601;
+            desc.bgr        = false;
+            manifest.streams.push_back(desc);
+        }
+        else if (directive == "matrix")
+        {
+            std::string name, matrix;
+            size_t      index;
+            if (!(strm >> name >> matrix) || !find_stream(manifest, name, index))
+            {
+                EPRINTF1("%s:%d: matrix refers to an undeclared stream", filename.c_str(), line_no);
+                return false;
+            }
+            if (matrix == "bt601")
+            {
+                manifest.streams[index].yuv_matrix = YUV_MATRIX_BT601;
+            }
+            else if (matrix == "bt709")
+            {
+                manifest.streams[index].yuv_matrix = YUV_MATRIX_BT709;
+            }
+            else if (matrix == "bt2020")
+            {
+                manifest.streams[index].yuv_matrix = YUV_MATRIX_BT2020;
+            }
+            else
+            {
+                EPRINTF1("%s:%d: unknown matrix %s", filename.c_str(), line_no, matrix.c_str());
+                return false;
+            }
+        }
+        else if (directive == "order")
+        {
+            std::string name, order;
+            size_t      index;
+            if (!(strm >> name >> order) || !find_stream(manifest, name, index))
+            {
+                EPRINTF1("%s:%d: order refers to an undeclared stream", filename.c_str(), line_no);
+                return false;
+            }
+            if (order != "rgb" && order != "bgr")
+            {
+                EPRINTF1("%s:%d: expected 'order <stream name> rgb|bgr'", filename.c_str(), line_no);
+                return false;
+            }
+            manifest.streams[index].bgr = order == "bgr";
+        }
+        else if (directive == "readback")
+        {
+            std::string depth, mode;
+            strm >> depth >> mode;
+            if (depth == "rgba8")
+            {
+                manifest.readback = READBACK_RGBA8;
+            }
+            else if (depth == "rgb10")
+            {
+                manifest.readback = READBACK_RGB10_A2;
+            }
+            else if (depth == "rgba16f")
+            {
+                manifest.readback = READBACK_RGBA16F;
+            }
+            else if (depth == "nv12")
+            {
+                manifest.readback = READBACK_NV12;
+            }
+            else
+            {
+                EPRINTF1("%s:%d: expected 'readback rgba8|rgb10|rgba16f|nv12 [sync|pbo]'", filename.c_str(), line_no);
+                return false;
+            }
+            if (mode.empty() || mode == "sync")
+            {
+                manifest.readback_mode = READBACK_SYNC;
+            }
+            else if (mode == "pbo")
+            {
+                manifest.readback_mode = READBACK_PBO;
+            }
+            else
+            {
+                EPRINTF1("%s:%d: expected 'readback rgba8|rgb10|rgba16f|nv12 [sync|pbo]'", filename.c_str(), line_no);
+                return false;
+            }
+        }
+        else if (directive == "upload")
+        {
+            std::string mode;
+            strm >> mode;
+            if (mode == "direct")
+            {
+                manifest.upload = UPLOAD_DIRECT;
+            }
+            else if (mode == "pbo")
+            {
+                manifest.upload = UPLOAD_PBO;
+            }
+            else
+            {
+                EPRINTF1("%s:%d: expected 'upload direct|pbo'", filename.c_str(), line_no);
+                return false;
+            }
+        }
+        else if (directive == "atlas")
+        {
+            manifest.atlas = true;
+        }
+        else if (directive == "instanced")
+        {
+            manifest.instanced = true;
+        }
+        else if (directive == "output")
+        {
+            if (!(strm >> manifest.output_width >> manifest.output_height)
+                || manifest.output_width == 0 || manifest.output_height == 0)
+            {
+                EPRINTF1("%s:%d: expected 'output <width> <height>'", filename.c_str(), line_no);
+                return false;
+            }
+        }
+        else if (directive == "preview")
+        {
+            std::string state;
+            strm >> state;
+            if (state != "on" && state != "off")
+            {
+                EPRINTF1("%s:%d: expected 'preview on|off'", filename.c_str(), line_no);
+                return false;
+            }
+            manifest.preview = state == "on";
+        }
+        else if (directive == "orientation")
+        {
+            std::string orientation;
+            strm >> orientation;
+            if (orientation != "bottom-up" && orientation != "top-down")
+            {
+                EPRINTF1("%s:%d: expected 'orientation bottom-up|top-down'", filename.c_str(), line_no);
+                return false;
+            }
+            manifest.top_down = orientation == "top-down";
+        }
+        else if (directive == "tile")
+        {
+            std::string name;
+            size_t      index;
+            if (!(strm >> name) || !find_stream(manifest, name, index))
+            {
+                EPRINTF1("%s:%d: tile refers to an undeclared stream", filename.c_str(), line_no);
+                return false;
+            }
+            tile_rect_t rect;
+            if (strm >> rect.x)
+            {
+                if (!(strm >> rect.y >> rect.width >> rect.height) || rect.width <= 0.0f || rect.height <= 0.0f)
+                {
+                    EPRINTF1("%s:%d: expected 'tile <stream name> [<x> <y> <width> <height>]'", filename.c_str(),
+                             line_no);
+                    return false;
+                }
+                manifest.layout.rects.push_back(rect);
+            }
+            manifest.tile_streams.push_back(index);
+        }
+        else if (directive == "layout")
+        {
+            std::string mode;
+            strm >> mode;
+            if (mode == "grid")
+            {
+                manifest.layout.mode    = LAYOUT_GRID;
+                manifest.layout.columns = 0;
+                manifest.layout.rows    = 0;
+                if ((strm >> manifest.layout.columns)
+                    && (!(strm >> manifest.layout.rows) || manifest.layout.columns == 0 || manifest.layout.rows == 0))
+                {
+                    EPRINTF1("%s:%d: expected 'layout grid [<columns> <rows>]'", filename.c_str(), line_no);
+                    return false;
+                }
+            }
+            else if (mode == "pip")
+            {
+                manifest.layout.mode = LAYOUT_PIP;
+            }
+            else
+            {
+                EPRINTF1("%s:%d: expected 'layout grid [<columns> <rows>]|pip'", filename.c_str(), line_no);
+                return false;
+            }
+        }
+        else if (directive == "letterbox")
+        {
+            manifest.layout.letterbox = true;
+        }
+        else
+        {
+            EPRINTF1("%s:%d: unknown directive %s", filename.c_str(), line_no, directive.c_str());
+            return false;
+        }
+    }
+
+    if (manifest.streams.empty())
+    {
+        EPRINTF1("%s declares no streams", filename.c_str());
+        return false;
+    }
+    if (!manifest.layout.rects.empty())
+    {
+        if (manifest.layout.rects.size() != manifest.tile_streams.size())
+        {
+            EPRINTF1("%s: either every tile or none has a rectangle", filename.c_str());
+            return false;
+        }
+        manifest.layout.mode = LAYOUT_RECTS;
+    }
+    // A size that follows the window can only be checked once it is known.
+    if (manifest.readback == READBACK_NV12 && manifest.output_width
+        && (manifest.output_width % 4 || manifest.output_height % 2))
+    {
+        EPRINTF1("%s: NV12 read back needs an output width that is a multiple of 4 and an even height, not %ux%u",
+                 filename.c_str(), manifest.output_width, manifest.output_height);
+        return false;
+    }
+    if (manifest.tile_streams.empty())
+    {
+        for (size_t i = 0; i < manifest.streams.size(); ++i)
+        {
+            manifest.tile_streams.push_back(i);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------------------------
+// File: stream_manifest.h
+// Desc: Binds independent input streams to the tiles of the composite.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_STREAM_MANIFEST_H
+#define ANDROID_SHADER_DEMO_JNI_STREAM_MANIFEST_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+#include "tile_layout.h"
+
+/**
+ * \brief YUV to RGB conversion matrices for YUV streams. All assume
+ *        limited-range video levels (16-235 at 8 bits, 64-940 at 10 bits).
+ */
+enum yuv_matrix_t
+{
+    YUV_MATRIX_BT601 = 0,
+    YUV_MATRIX_BT709,
+    YUV_MATRIX_BT2020,
+};
+
+/**
+ * \brief Pixel layout the composite is read back in.
+ *
+ *        READBACK_RGBA8     - 8 bits per channel
+ *        READBACK_RGB10_A2  - 10 bits per colour channel packed in 32 bits
+ *        READBACK_RGBA16F   - half float per channel
+ *        READBACK_NV12      - BT.601 limited range NV12, converted and packed
+ *                             on the GPU so one and a half bytes per pixel
+ *                             are read back; needs an output width that is a
+ *                             multiple of 4 and an even height
+ *
+ *        The deeper layouts composite in half float and need OpenGL ES 3.
+ */
+enum readback_format_t
+{
+    READBACK_RGBA8 = 0,
+    READBACK_RGB10_A2,
+    READBACK_RGBA16F,
+    READBACK_NV12,
+};
+
+/**
+ * \brief How the composite reaches the CPU.
+ *
+ *        READBACK_SYNC - glReadPixels into client memory, which blocks the GL
+ *                        thread until the GPU has finished the frame.
+ *        READBACK_PBO  - glReadPixels into a ring of pixel pack buffers, each
+ *                        mapped a tick or two later once its fence has
+ *                        signalled. Needs OpenGL ES 3.
+ */
+enum readback_mode_t
+{
+    READBACK_SYNC = 0,
+    READBACK_PBO,
+};
+
+/**
+ * \brief How frames reach their textures.
+ *
+ *        UPLOAD_DIRECT - glTexSubImage2D from client memory, which blocks the
+ *                        GL thread until the driver has copied the frame.
+ *        UPLOAD_PBO    - The ingest thread writes into mapped pixel unpack
+ *                        buffers, and the GPU copies them asynchronously.
+ *                        Needs OpenGL ES 3.
+ */
+enum upload_mode_t
+{
+    UPLOAD_DIRECT = 0,
+    UPLOAD_PBO,
+};
+
+/**
+ * \brief One input stream: where its frames come from and what they look like.
+ *        A format with zero width means the file is a raw stream container
+ *        that describes itself. bgr marks RGB24 frames stored blue first.
+ */
+struct stream_desc_t
+{
+    std::string    name;
+    std::string    path;
+    frame_format_t format;
+    yuv_matrix_t   yuv_matrix;
+    bool           bgr;
+};
+
+/**
+ * \brief The streams to open and, for every tile in layout order, the index of
+ *        the stream it shows. Several tiles may show the same stream; it is
+ *        still read and uploaded only once per frame.
+ */
+struct stream_manifest_t
+{
+    std::vector<stream_desc_t> streams;
+    std::vector<size_t>        tile_streams;
+    readback_format_t          readback;
+    readback_mode_t            readback_mode;
+    upload_mode_t              upload;
+    bool                       atlas;
+    bool                       instanced;
+    tile_layout_t              layout;
+    uint32_t                   output_width;
+    uint32_t                   output_height;
+    bool                       preview;
+    bool                       top_down;
+};
+
+/**
+ * \brief Loads a manifest from a text file with one directive per line:
+ *
+ *            # comment
+ *            stream <name> <path> [<width> <height> [rgb24|nv12|y8|mipi10|p010|tp10]]
+ *            matrix <stream name> bt601|bt709|bt2020
+ *            order <stream name> rgb|bgr
+ *            tile <stream name> [<x> <y> <width> <height>]
+ *            layout grid [<columns> <rows>]|pip
+ *            letterbox
+ *            readback rgba8|rgb10|rgba16f|nv12 [sync|pbo]
+ *            upload direct|pbo
+ *            atlas
+ *            instanced
+ *            output <width> <height>
+ *            preview on|off
+ *            orientation bottom-up|top-down
+ *
+ *        A stream without dimensions is read as a raw stream container. YUV
+ *        streams are converted with BT.601 unless a matrix line says otherwise,
+ *        and rgb24 streams are taken as red first unless an order line says bgr.
+ *        Tiles are laid out in the order they are listed. When no tile lines
+ *        are given, every stream gets one tile in the order it was declared.
+ *        Tiles go on an automatic grid unless a layout line says otherwise, or
+ *        every tile line gives a rectangle in fractions of the output, top
+ *        left origin. With a letterbox line tiles keep their input's aspect
+ *        ratio. Overlapping tiles are drawn grouped by pixel format. The
+ *        composite is read back synchronously as rgba8 and frames are uploaded
+ *        directly unless readback and upload lines say otherwise. With an atlas line,
+ *        rgb24 and y8 streams share a few large textures instead of one each,
+ *        so their tiles draw with one call per texture. With an instanced line
+ *        and OpenGL ES 3, rgb24 and y8 streams of one size are layers of a
+ *        texture array instead, and all their tiles draw as one instanced
+ *        call; the atlas then only takes the streams left over. With an
+ *        output line tiles are composited offscreen at that size, whatever the
+ *        window, and read back from there; the window then only shows a scaled
+ *        preview, which preview off skips. Frames are read back bottom row
+ *        first, as GL stores them, unless orientation top-down has the tiles
+ *        composited upside down offscreen so rows come back top row first.
+ *
+ * @param filename
+ * @param manifest [out]
+ * @return false if the file can't be read or has an invalid directive
+ */
+bool load_stream_manifest(const std::string &filename, stream_manifest_t &manifest);
+
+/**
+ * \brief Parses a pixel format name as used in manifests, e.g. "rgb24".
+ *
+ * @param name
+ * @param pixel_format [out]
+ * @return false if the name is unknown
+ */
+bool parse_pixel_format(const std::string &name, pixel_format_t &pixel_format);
+
+#endif //ANDROID_SHADER_DEMO_JNI_STREAM_MANIFEST_H
@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// File: tile_layout.cpp
+// Desc: Places the tiles of the composite on the output.
+//--------------------------------------------------------------------------------------
+#include "tile_layout.h"
+
+#include <cmath>
+
+// Picture-in-picture insets: side as a fraction of the output, and the gap
+// between them and to the edges.
+static const float PIP_INSET_SIZE   = 0.25f;
+static const float PIP_INSET_MARGIN = 0.02f;
+
+tile_layout_t make_grid_layout()
+{
+    tile_layout_t layout;
+    layout.mode      = LAYOUT_GRID;
+    layout.columns   = 0;
+    layout.rows      = 0;
+    layout.letterbox = false;
+    return layout;
+}
+
+static tile_rect_t make_rect(float x, float y, float width, float height)
+{
+    tile_rect_t rect;
+    rect.x      = x;
+    rect.y      = y;
+    rect.width  = width;
+    rect.height = height;
+    return rect;
+}
+
+// Shrinks a cell to the input's aspect ratio, centred.
+static tile_rect_t letterbox_rect(const tile_rect_t &cell, float aspect, float output_aspect)
+{
+    if (aspect <= 0.0f || cell.width <= 0.0f || cell.height <= 0.0f)
+    {
+        return cell;
+    }
+    const float cell_aspect = cell.width / cell.height * output_aspect;
+    if (cell_aspect > aspect)
+    {
+        const float width = cell.width * aspect / cell_aspect;
+        return make_rect(cell.x + (cell.width - width) * 0.5f, cell.y, width, cell.height);
+    }
+    const float height = cell.height * cell_aspect / aspect;
+    return make_rect(cell.x, cell.y + (cell.height - height) * 0.5f, cell.width, height);
+}
+
+void layout_tiles(const tile_layout_t &layout, const std::vector<float> &aspects, uint32_t output_width,
+                  uint32_t output_height, std::vector<tile_rect_t> &rects)
+{
+    const size_t tiles = aspects.size();
+    rects.assign(tiles, make_rect(0.0f, 0.0f, 0.0f, 0.0f));
+    if (tiles == 0)
+    {
+        return;
+    }
+
+    switch (layout.mode)
+    {
+        case LAYOUT_GRID:
+        {
+            uint32_t columns = layout.columns, rows = layout.rows;
+            if (columns == 0 || rows == 0)
+            {
+                columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(tiles))));
+                rows    = static_cast<uint32_t>((tiles + columns - 1) / columns);
+            }
+            for (size_t t = 0; t < tiles && t < static_cast<size_t>(columns) * rows; ++t)
+            {
+                rects[t] = make_rect(static_cast<float>(t % columns) / columns,
+                                     static_cast<float>(t / columns) / rows, 1.0f / columns, 1.0f / rows);
+            }
+            break;
+        }
+        case LAYOUT_PIP:
+        {
+            rects[0] = make_rect(0.0f, 0.0f, 1.0f, 1.0f);
+            const float  step       = PIP_INSET_SIZE + PIP_INSET_MARGIN;
+            const size_t per_column = static_cast<size_t>((1.0f - PIP_INSET_MARGIN) / step);
+            for (size_t t = 1; t < tiles; ++t)
+            {
+                const size_t column = (t - 1) / per_column, row = (t - 1) % per_column;
+                const float  x      = 1.0f - (column + 1) * step;
+                if (x < 0.0f)
+                {
+                    break;
+                }
+                rects[t] = make_rect(x, 1.0f - (row + 1) * step, PIP_INSET_SIZE, PIP_INSET_SIZE);
+            }
+            break;
+        }
+        case LAYOUT_RECTS:
+            for (size_t t = 0; t < tiles && t < layout.rects.size(); ++t)
+            {
+                rects[t] = layout.rects[t];
+            }
+            break;
+    }
+
+    if (layout.letterbox && output_width && output_height)
+    {
+        const float output_aspect = static_cast<float>(output_width) / output_height;
+        for (size_t t = 0; t < tiles; ++t)
+        {
+            rects[t] = letterbox_rect(rects[t], aspects[t], output_aspect);
+        }
+    }
+}
+
+void tile_vertices(const tile_rect_t &rect, float *positions, float *tex_coords)
+{
+    const float x0 = rect.x * 2.0f - 1.0f;
+    const float x1 = x0 + rect.width * 2.0f;
+    const float y1 = 1.0f - rect.y * 2.0f;
+    const float y0 = y1 - rect.height * 2.0f;
+    const float corners[] = {
+            x0, y0,  x1, y0,  x0, y1,
+            x0, y1,  x1, y0,  x1, y1
+    };
+    const float uvs[] = {
+            0.0f, 1.0f,  1.0f, 1.0f,  0.0f, 0.0f,
+            0.0f, 0.0f,  1.0f, 1.0f,  1.0f, 0.0f
+    };
+    for (int i = 0; i < 12; ++i)
+    {
+        positions[i]  = corners[i];
+        tex_coords[i] = uvs[i];
+    }
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: tile_layout.h
+// Desc: Places the tiles of the composite on the output.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_TILE_LAYOUT_H
+#define ANDROID_SHADER_DEMO_JNI_TILE_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief How tiles are arranged.
+ *
+ *        LAYOUT_GRID  - columns x rows cells filled row by row, top left
+ *                       first. Zero columns picks the smallest square-ish
+ *                       grid with a cell for every tile.
+ *        LAYOUT_PIP   - The first tile fills the output; the others are
+ *                       insets stacked up from its bottom right corner.
+ *        LAYOUT_RECTS - Every tile has its own rectangle.
+ */
+enum layout_mode_t
+{
+    LAYOUT_GRID = 0,
+    LAYOUT_PIP,
+    LAYOUT_RECTS,
+};
+
+/**
+ * \brief A rectangle in fractions of the output, top left origin.
+ */
+struct tile_rect_t
+{
+    float x;
+    float y;
+    float width;
+    float height;
+};
+
+/**
+ * \brief A layout as configured, independent of the output size. rects is
+ *        only used by LAYOUT_RECTS, one per tile. With letterbox, every tile
+ *        keeps its input's aspect ratio and is centred in its cell.
+ */
+struct tile_layout_t
+{
+    layout_mode_t            mode;
+    uint32_t                 columns;
+    uint32_t                 rows;
+    bool                     letterbox;
+    std::vector<tile_rect_t> rects;
+};
+
+/**
+ * \brief Returns an automatic grid layout without letterboxing.
+ * @return
+ */
+tile_layout_t make_grid_layout();
+
+/**
+ * \brief Computes the rectangle of every tile.
+ *
+ *        Tiles the layout has no cell for get an empty rectangle.
+ *
+ * @param layout
+ * @param aspects - Width / height of the input shown by every tile, used for letterboxing
+ * @param output_width - In pixels; letterboxing is skipped while it is 0
+ * @param output_height
+ * @param rects [out] - One per entry of aspects
+ */
+void layout_tiles(const tile_layout_t &layout, const std::vector<float> &aspects, uint32_t output_width,
+                  uint32_t output_height, std::vector<tile_rect_t> &rects);
+
+/**
+ * \brief Writes the two triangles covering a rectangle as 6 clip space
+ *        positions and 6 texture coordinates, with the input's first row at
+ *        the top of the rectangle.
+ *
+ * @param rect
+ * @param positions [out] - 12 floats
+ * @param tex_coords [out] - 12 floats
+ */
+void tile_vertices(const tile_rect_t &rect, float *positions, float *tex_coords);
+
+#endif //ANDROID_SHADER_DEMO_JNI_TILE_LAYOUT_H
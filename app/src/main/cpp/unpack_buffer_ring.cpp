@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// File: unpack_buffer_ring.cpp
+// Desc: Ring of mapped pixel unpack buffers for asynchronous uploads.
+//--------------------------------------------------------------------------------------
+#include "unpack_buffer_ring.h"
+#include "log_sink.h"
+
+#define LOG_TAG    "unpack_buffer_ring.cpp"
+
+#define EPRINTF1(...)  log_print(LOG_LEVEL_ERROR,LOG_TAG,__VA_ARGS__)
+
+unpack_buffer_ring::unpack_buffer_ring()
+    : m_buffer_bytes(0)
+{
+}
+
+bool unpack_buffer_ring::create(size_t buffer_count, size_t buffer_bytes)
+{
+    release();
+
+    m_buffer_bytes = buffer_bytes;
+    m_buffers.resize(buffer_count);
+    m_fences.assign(buffer_count, (GLsync) NULL);
+    m_mappings.assign(buffer_count, (unsigned char *) NULL);
+    m_fenced_at.resize(buffer_count);
+    glGenBuffers(buffer_count, m_buffers.data());
+    for (size_t i = 0; i < buffer_count; ++i)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_bytes, NULL, GL_STREAM_DRAW);
+        if (!map(i))
+        {
+            EPRINTF1("Can't map a %zu byte unpack buffer", buffer_bytes);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            release();
+            return false;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+void unpack_buffer_ring::release()
+{
+    for (size_t i = 0; i < m_buffers.size(); ++i)
+    {
+        if (m_fences[i])
+        {
+            glDeleteSync(m_fences[i]);
+        }
+        if (m_mappings[i])
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!m_buffers.empty())
+    {
+        glDeleteBuffers(m_buffers.size(), m_buffers.data());
+    }
+    abandon();
+}
+
+void unpack_buffer_ring::abandon()
+{
+    m_buffers.clear();
+    m_fences.clear();
+    m_mappings.clear();
+    m_fenced_at.clear();
+    m_buffer_bytes = 0;
+}
+
+size_t unpack_buffer_ring::count() const
+{
+    return m_buffers.size();
+}
+
+const std::vector<unsigned char *> &unpack_buffer_ring::mappings() const
+{
+    return m_mappings;
+}
+
+unsigned char *unpack_buffer_ring::map(size_t index)
+{
+    // The fence guarantees the GPU is done with the old contents, so the
+    // driver need not synchronise, and they need not be preserved.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[index]);
+    m_mappings[index] = static_cast<unsigned char *>(
+            glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_buffer_bytes,
+                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    return m_mappings[index];
+}
+
+bool unpack_buffer_ring::bind_for_upload(size_t index)
+{
+    if (index >= m_buffers.size() || !m_mappings[index])
+    {
+        return false;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[index]);
+    m_mappings[index] = NULL;
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+    {
+        // The contents were lost, e.g. to a display mode change; skip this frame.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    return true;
+}
+
+void unpack_buffer_ring::fence(size_t index)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (m_fences[index])
+    {
+        glDeleteSync(m_fences[index]);
+    }
+    m_fences[index]    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_fenced_at[index] = std::chrono::steady_clock::now();
+}
+
+unsigned char *unpack_buffer_ring::try_reclaim(size_t index)
+{
+    if (m_mappings[index])
+    {
+        return m_mappings[index];
+    }
+    if (m_fences[index])
+    {
+        // Flush on the first poll so the fence is guaranteed to signal eventually.
+        const GLenum status = glClientWaitSync(m_fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            return NULL;
+        }
+        glDeleteSync(m_fences[index]);
+        m_fences[index] = NULL;
+        m_in_flight.add(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - m_fenced_at[index]).count());
+    }
+    unsigned char *mapping = map(index);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return mapping;
+}
+
+stage_timer &unpack_buffer_ring::in_flight()
+{
+    return m_in_flight;
+}
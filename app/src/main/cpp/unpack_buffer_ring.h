@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: unpack_buffer_ring.h
+// Desc: Ring of mapped pixel unpack buffers for asynchronous uploads.
+//--------------------------------------------------------------------------------------
+
+#ifndef ANDROID_SHADER_DEMO_JNI_UNPACK_BUFFER_RING_H
+#define ANDROID_SHADER_DEMO_JNI_UNPACK_BUFFER_RING_H
+
+#include <GLES3/gl3.h>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "stage_timer.h"
+
+/**
+ * \brief GL_PIXEL_UNPACK_BUFFER objects that are kept mapped while a producer
+ *        fills them and unmapped only while the GPU copies them into a texture.
+ *
+ * Every buffer cycles through: mapped (written by any thread) -> bound for an
+ * upload -> fenced -> mapped again once the fence has signalled. The GL calls
+ * all happen on the thread owning the context; only the mapped memory is
+ * shared. Needs OpenGL ES 3.
+ */
+class unpack_buffer_ring {
+public:
+    unpack_buffer_ring();
+
+    /**
+     * \brief Creates and maps buffer_count buffers of buffer_bytes each.
+     *
+     * @param buffer_count
+     * @param buffer_bytes
+     * @return false if a buffer can't be allocated or mapped
+     */
+    bool                              create(size_t buffer_count, size_t buffer_bytes);
+
+    /**
+     * \brief Unmaps and deletes every buffer and fence.
+     */
+    void                              release();
+
+    /**
+     * \brief Forgets every buffer and fence without unmapping or deleting
+     *        them, once the context they were created on is gone. Needs no
+     *        context.
+     */
+    void                              abandon();
+
+    size_t                            count() const;
+
+    /**
+     * \brief Gets the current mapping of every buffer, indexed like the buffers.
+     * @return
+     */
+    const std::vector<unsigned char *> &mappings() const;
+
+    /**
+     * \brief Unmaps a buffer and binds it to GL_PIXEL_UNPACK_BUFFER, so texture
+     *        uploads read from it at offsets instead of client pointers.
+     *
+     * @param index
+     * @return false if the buffer isn't mapped or can't be unmapped
+     */
+    bool                              bind_for_upload(size_t index);
+
+    /**
+     * \brief Unbinds the buffer after its uploads were issued and fences them.
+     * @param index
+     */
+    void                              fence(size_t index);
+
+    /**
+     * \brief Maps a fenced buffer again if the GPU has finished reading it.
+     *        Never waits.
+     *
+     * @param index
+     * @return the new mapping, or NULL while the upload is still in flight
+     */
+    unsigned char                    *try_reclaim(size_t index);
+
+    /**
+     * \brief Time from fence() until try_reclaim() found the upload complete,
+     *        i.e. how long the copy overlapped with other work.
+     * @return
+     */
+    stage_timer                      &in_flight();
+
+private:
+    unsigned char                    *map(size_t index);
+
+    // Data members
+    std::vector<GLuint>               m_buffers;
+    std::vector<GLsync>               m_fences;
+    std::vector<unsigned char *>      m_mappings;
+    std::vector<std::chrono::steady_clock::time_point> m_fenced_at;
+    size_t                            m_buffer_bytes;
+    stage_timer                       m_in_flight;
+};
+
+#endif //ANDROID_SHADER_DEMO_JNI_UNPACK_BUFFER_RING_H
@@ -49,7 +49,7 @@ static void write_le(std::ostream &out, UIntType val)
     unsigned char byte = 0;
     for (uint32_t i = 0; i < sizeof(UIntType); ++i)
     {
-        byte = (val & (0xFF << (i * 8))) >> (i * 8);
+        byte = static_cast<unsigned char>((val >> (i * 8)) & 0xFF);
         out.put(*reinterpret_cast<char *>(&byte));
     }
 }
@@ -62,7 +62,7 @@ static UIntType read_le(std::istream &in)
     for (uint32_t i = 0; i < sizeof(UIntType); ++i)
     {
         in.get(*reinterpret_cast<char *>(&byte));
-        val |= byte << (i * 8);
+        val |= static_cast<UIntType>(byte) << (i * 8);
     }
     return val;
 }
@@ -296,6 +296,89 @@ void save_p010_image_data(const std::string &filename, const p010_image_t &image
     save_yuv_file_internal(filename, image, CL_QCOM_UNORM_INT10, CL_QCOM_P010, 2);
 }
 
+// "RSTM" in file order
+static const uint32_t STREAM_MAGIC   = 0x4D545352;
+static const uint32_t STREAM_VERSION = 1;
+
+const size_t STREAM_HEADER_SIZE = 9 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+void write_stream_header(std::ostream &out, const stream_header_t &header)
+{
+    write_le<uint32_t>(out, STREAM_MAGIC);
+    write_le<uint32_t>(out, STREAM_VERSION);
+    write_le<uint32_t>(out, header.width);
+    write_le<uint32_t>(out, header.height);
+    write_le<uint32_t>(out, header.data_type);
+    write_le<uint32_t>(out, header.order);
+    write_le<uint32_t>(out, header.stride);
+    write_le<uint32_t>(out, header.fps_num);
+    write_le<uint32_t>(out, header.fps_den);
+    write_le<uint64_t>(out, header.frame_count);
+    write_le<uint64_t>(out, header.index_offset);
+}
+
+bool read_stream_header(std::istream &in, stream_header_t &header)
+{
+    const uint32_t magic   = read_le<uint32_t>(in);
+    const uint32_t version = read_le<uint32_t>(in);
+    if (!in || magic != STREAM_MAGIC || version != STREAM_VERSION)
+    {
+        std::cerr << "Expected a version " << STREAM_VERSION << " raw stream container\n";
+        return false;
+    }
+    header.width        = read_le<uint32_t>(in);
+    header.height       = read_le<uint32_t>(in);
+    header.data_type    = read_le<uint32_t>(in);
+    header.order        = read_le<uint32_t>(in);
+    header.stride       = read_le<uint32_t>(in);
+    header.fps_num      = read_le<uint32_t>(in);
+    header.fps_den      = read_le<uint32_t>(in);
+    header.frame_count  = read_le<uint64_t>(in);
+    header.index_offset = read_le<uint64_t>(in);
+    return static_cast<bool>(in);
+}
+
+void write_stream_index(std::ostream &out, const std::vector<stream_index_entry_t> &index)
+{
+    for (const auto &entry : index)
+    {
+        write_le<uint64_t>(out, entry.offset);
+        write_le<uint64_t>(out, entry.timestamp_us);
+    }
+}
+
+bool read_stream_index(std::istream &in, const stream_header_t &header, std::vector<stream_index_entry_t> &index)
+{
+    // Check the index against the file length before sizing anything by a
+    // frame count that came straight from the file.
+    in.seekg(0, std::ios::end);
+    const std::streamoff length = in.tellg();
+    const uint64_t entry_bytes = 2 * sizeof(uint64_t);
+    if (!in || length < 0
+        || header.index_offset < STREAM_HEADER_SIZE
+        || header.index_offset > static_cast<uint64_t>(length)
+        || header.frame_count > (static_cast<uint64_t>(length) - header.index_offset) / entry_bytes)
+    {
+        std::cerr << "Raw stream container index lies outside the file\n";
+        index.clear();
+        return false;
+    }
+    in.seekg(static_cast<std::streamoff>(header.index_offset), std::ios::beg);
+    index.resize(static_cast<size_t>(header.frame_count));
+    for (auto &entry : index)
+    {
+        entry.offset       = read_le<uint64_t>(in);
+        entry.timestamp_us = read_le<uint64_t>(in);
+    }
+    if (!in)
+    {
+        std::cerr << "Raw stream container index is truncated\n";
+        index.clear();
+        return false;
+    }
+    return true;
+}
+
 size_t work_units(size_t x, size_t r)
 {
     return (x + r - 1) / r;
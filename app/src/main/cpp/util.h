@@ -13,6 +13,7 @@
 #define SDK_EXAMPLES_UTIL_H
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -36,16 +37,18 @@ struct tp10_image_t : public yuv_image_t {};
 
 struct p010_image_t : public yuv_image_t {};
 
+// The element types are spelled without the cl_* typedefs: their alignment
+// attributes can't be carried into a template argument and only draw warnings.
 struct matrix_t
 {
     int width, height;
-    std::vector<cl_float> elements;
+    std::vector<float> elements;
 };
 
 struct half_matrix_t
 {
     int width, height;
-    std::vector<cl_half> elements;
+    std::vector<uint16_t> elements;
 };
 
 /**
@@ -245,6 +248,79 @@ void save_single_channel_image_data(const std::string &filename, const single_ch
  */
 single_channel_int16_image_t load_single_channel_image_data(const std::string &filename);
 
+/**
+ * \brief Header of a raw stream container. Like the image files above it starts
+ *        with width, height, data type and channel order, using the same CL
+ *        enums, followed by the row stride in bytes and the frame rate as a
+ *        fraction. frame_count and index_offset locate the trailing frame index.
+ *
+ *        The file holds, in little-endian byte order:
+ *
+ *            | magic | version | header fields | frame data ... | frame index |
+ *
+ *        where the frame index is frame_count pairs of 64-bit (offset,
+ *        timestamp in microseconds).
+ */
+struct stream_header_t
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t data_type;
+    uint32_t order;
+    uint32_t stride;
+    uint32_t fps_num;
+    uint32_t fps_den;
+    uint64_t frame_count;
+    uint64_t index_offset;
+};
+
+/**
+ * \brief One entry of a stream container's frame index.
+ */
+struct stream_index_entry_t
+{
+    uint64_t offset;
+    uint64_t timestamp_us;
+};
+
+/**
+ * \brief Size in bytes of a serialized stream_header_t, i.e. the offset of the
+ *        first frame.
+ */
+extern const size_t STREAM_HEADER_SIZE;
+
+/**
+ * \brief Writes a stream container header at the current stream position.
+ * @param out
+ * @param header
+ */
+void write_stream_header(std::ostream &out, const stream_header_t &header);
+
+/**
+ * \brief Reads and validates a stream container header.
+ * @param in
+ * @param header [out]
+ * @return false if the stream is not a container of a supported version
+ */
+bool read_stream_header(std::istream &in, stream_header_t &header);
+
+/**
+ * \brief Writes a stream container's frame index at the current stream position.
+ * @param out
+ * @param index
+ */
+void write_stream_index(std::ostream &out, const std::vector<stream_index_entry_t> &index);
+
+/**
+ * \brief Reads the frame index described by header.
+ * @param in
+ * @param header
+ * @param index [out]
+ * @return false if the index is truncated or doesn't fit between the header
+ *         and the end of the file
+ */
+bool read_stream_index(std::istream &in, const stream_header_t &header, std::vector<stream_index_entry_t> &index);
+
 /**
  * \brief Returns smallest y such that y % r == 0 and y >= x
  * @param x
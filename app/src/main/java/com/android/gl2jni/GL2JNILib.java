@@ -22,6 +22,8 @@ import android.content.Context;
 import android.graphics.Bitmap;
 import android.util.Xml;
 
+import java.nio.ByteBuffer;
+
 import org.xmlpull.v1.XmlPullParser;
 
 public class GL2JNILib {
@@ -35,6 +37,17 @@ public class GL2JNILib {
      public static native void step();
      public static native void loadShader(String vs, String fs);
 
+     // Keeps the last depth composited frames for pullFrame(); 0 keeps none.
+     // May be called on any thread, also before the surface exists; the depth
+     // takes effect with the next frame drawn.
+     public static native void setPullQueue(int depth);
+     // Returns the oldest kept frame, or null, without waiting. The buffer wraps
+     // native memory and must be handed back through releaseFrame() once read;
+     // info, if at least 5 long, receives the frame id, pixel layout, row bytes,
+     // rows and 1 if the rows are stored top row first.
+     public static native ByteBuffer pullFrame(long[] info);
+     public static native void releaseFrame(ByteBuffer frame);
+
      public static void readAssets(Context c, String assetPath, String[] ss) {
           try {
                XmlPullParser xp = Xml.newPullParser();
@@ -92,7 +92,7 @@ class GL2JNIView extends GLSurfaceView {
             this.getHolder().setFormat(PixelFormat.TRANSLUCENT);
         }
 
-        /* Setup the context factory for 2.0 rendering.
+        /* Setup the context factory for 3.0 rendering, or 2.0 where 3.0 is missing.
          * See ContextFactory class definition below
          */
         setEGLContextFactory(new ContextFactory());
@@ -114,10 +114,19 @@ class GL2JNIView extends GLSurfaceView {
         private static int EGL_CONTEXT_CLIENT_VERSION = 0x3098;
 
         public EGLContext createContext(EGL10 egl, EGLDisplay display, EGLConfig eglConfig) {
-            Log.w(TAG, "creating OpenGL ES 2.0 context");
+            /* 3.0 enables the 10-bit input formats and high bit depth read back;
+             * everything else runs on 2.0.
+             */
+            Log.w(TAG, "creating OpenGL ES 3.0 context");
             checkEglError("Before eglCreateContext", egl);
-            int[] attrib_list = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL10.EGL_NONE};
-            EGLContext context = egl.eglCreateContext(display, eglConfig, EGL10.EGL_NO_CONTEXT, attrib_list);
+            int[] attrib_list3 = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL10.EGL_NONE};
+            EGLContext context = egl.eglCreateContext(display, eglConfig, EGL10.EGL_NO_CONTEXT, attrib_list3);
+            if (context == null || context == EGL10.EGL_NO_CONTEXT) {
+                egl.eglGetError();
+                Log.w(TAG, "creating OpenGL ES 2.0 context");
+                int[] attrib_list = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL10.EGL_NONE};
+                context = egl.eglCreateContext(display, eglConfig, EGL10.EGL_NO_CONTEXT, attrib_list);
+            }
             checkEglError("After eglCreateContext", egl);
             return context;
         }
@@ -185,9 +194,25 @@ class GL2JNIView extends GLSurfaceView {
             return chooseConfig(egl, display, configs);
         }
 
+        /* Prefer configs whose window surfaces can keep their contents across
+         * eglSwapBuffers(), so the renderer only has to redraw tiles that changed.
+         */
+        private static final int EGL_SWAP_BEHAVIOR_PRESERVED_BIT = 0x0400;
+
         public EGLConfig chooseConfig(EGL10 egl, EGLDisplay display,
                                       EGLConfig[] configs) {
+            EGLConfig config = chooseConfig(egl, display, configs, true);
+            return config != null ? config : chooseConfig(egl, display, configs, false);
+        }
+
+        private EGLConfig chooseConfig(EGL10 egl, EGLDisplay display,
+                                       EGLConfig[] configs, boolean preserved) {
             for (EGLConfig config : configs) {
+                int surfaceType = findConfigAttrib(egl, display, config,
+                        EGL10.EGL_SURFACE_TYPE, 0);
+                if (preserved && (surfaceType & EGL_SWAP_BEHAVIOR_PRESERVED_BIT) == 0)
+                    continue;
+
                 int d = findConfigAttrib(egl, display, config,
                         EGL10.EGL_DEPTH_SIZE, 0);
                 int s = findConfigAttrib(egl, display, config,
@@ -350,7 +375,7 @@ class GL2JNIView extends GLSurfaceView {
         public void onSurfaceCreated(GL10 gl, EGLConfig config) {
             GL2JNILib.init(bitmap);
 
-            GL2JNILib.loadShaderAsset(context,"2xbr.shader");
+            GL2JNILib.loadShaderAsset(context,"stitch.shader");
         }
     }
 }